@@ -0,0 +1,218 @@
+#pragma once
+
+#include <renderer/math.hpp>
+#include <renderer/vulkan_renderer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <expected>
+#include <numbers>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+
+namespace presenter {
+
+// Rows of textured spheres that the camera flies along. Only the rows close to the camera are drawn, with LODs picked
+// by distance, so with enough (or large enough) textures the scene doesn't fit into memory at once and the renderer
+// has to stream resources in and evict them behind the camera. Colored point lights float between the spheres, which
+// the renderer bins into clusters.
+class DemoScene
+{
+public:
+    [[nodiscard]] static auto create(renderer::VulkanRenderer& renderer, u32 texture_count, u32 texture_size,
+                                     u32 light_count) -> std::expected<DemoScene, std::string>
+    {
+        auto sphere_lods = std::vector<std::pair<std::vector<renderer::Vertex>, std::vector<u32>>>{};
+
+        for (u32 segments : { 48u, 24u, 12u, 6u })
+            sphere_lods.push_back(create_sphere(segments, segments / 2));
+
+        auto lods = std::vector<renderer::MeshLod>{};
+
+        for (auto& [vertices, indices] : sphere_lods)
+            lods.push_back(renderer::MeshLod{ .vertices = vertices, .indices = indices });
+
+        auto sphere = renderer.create_mesh(lods);
+
+        if (!sphere)
+            return std::unexpected{ sphere.error() };
+
+        auto scene = DemoScene{ *sphere, static_cast<u32>(lods.size()) };
+
+        for (u32 i = 0; i < texture_count; i++)
+        {
+            auto texture = renderer.create_texture(texture_size, texture_size, create_checkerboard(texture_size, i));
+
+            if (!texture)
+                return std::unexpected{ texture.error() };
+
+            scene._textures.push_back(*texture);
+        }
+
+        const auto scene_length = static_cast<f32>(row_count(texture_count)) * spacing;
+        const auto scene_width = static_cast<f32>(columns) * spacing;
+
+        for (u32 i = 0; i < light_count; i++)
+        {
+            // Evenly spaced along the rows, scattered across them.
+            const auto x = (std::fmod(static_cast<f32>(i) * 0.618034f, 1.0f) - 0.5f) * scene_width;
+            const auto z = -(static_cast<f32>(i) + 0.5f) / static_cast<f32>(light_count) * scene_length;
+
+            scene._lights.push_back(renderer::PointLight{
+                .position = { x, 1.2f, z },
+                .radius = light_radius,
+                .color = { 0.5f + 0.5f * std::cos(static_cast<f32>(i) * 1.7f),
+                           0.5f + 0.5f * std::cos(static_cast<f32>(i) * 2.3f + 2.0f),
+                           0.5f + 0.5f * std::cos(static_cast<f32>(i) * 2.9f + 4.0f) },
+                .intensity = 4.0f,
+            });
+        }
+
+        return scene;
+    }
+
+    auto draw(renderer::VulkanRenderer& renderer, f64 time, f32 aspect_ratio) const -> void
+    {
+        namespace math = renderer::math;
+
+        const auto scene_length = static_cast<f32>(row_count(_textures.size())) * spacing;
+        const auto camera_z = -std::fmod(static_cast<f32>(time) * camera_speed, scene_length);
+
+        const auto eye = renderer::Vec3{ 0.0f, 3.0f, camera_z + 6.0f };
+        const auto target = renderer::Vec3{ 0.0f, 0.0f, camera_z - 4.0f };
+
+        renderer.set_camera(renderer::Camera{
+            .view = math::look_at(eye, target, { 0.0f, 1.0f, 0.0f }),
+            .projection = math::perspective(std::numbers::pi_v<f32> / 3.0f, aspect_ratio, 0.1f, view_distance * 2.0f),
+        });
+
+        const auto rotation = math::rotation_y(static_cast<f32>(time));
+
+        for (usize i = 0; i < _textures.size(); i++)
+        {
+            const auto column = static_cast<f32>(i % columns);
+            const auto row = static_cast<f32>(i / columns);
+            const auto center_offset = static_cast<f32>(columns - 1) / 2.0f;
+            const auto position = renderer::Vec3{ (column - center_offset) * spacing, 0.0f, -row * spacing };
+            const auto distance = camera_z - position[2];
+
+            // Behind the camera or too far ahead of it.
+            if (distance < -spacing || distance > view_distance)
+                continue;
+
+            const auto lod = std::min(static_cast<u32>(std::max(distance, 0.0f) / lod_distance), _lod_count - 1);
+
+            renderer.submit_draw(_sphere, lod, math::multiply(math::translation(position), rotation), _textures[i]);
+        }
+
+        for (usize i = 0; i < _lights.size(); i++)
+        {
+            auto light = _lights[i];
+            const auto distance = camera_z - light.position[2];
+
+            if (distance < -light.radius || distance > view_distance + light.radius)
+                continue;
+
+            light.position[1] += std::sin(static_cast<f32>(time) * 2.0f + static_cast<f32>(i)) * 0.8f;
+            renderer.submit_light(light);
+        }
+    }
+
+private:
+    constexpr static usize columns = 8;
+    constexpr static f32 spacing = 2.0f;
+    constexpr static f32 camera_speed = 4.0f;
+    constexpr static f32 view_distance = 40.0f;
+    constexpr static f32 lod_distance = 8.0f;
+    constexpr static f32 light_radius = 4.0f;
+
+    renderer::MeshHandle _sphere;
+    u32 _lod_count;
+    std::vector<renderer::TextureHandle> _textures{};
+    std::vector<renderer::PointLight> _lights{};
+
+private:
+    DemoScene(renderer::MeshHandle sphere, u32 lod_count) : _sphere{ sphere }, _lod_count{ lod_count } {}
+
+    static auto row_count(usize texture_count) -> usize
+    {
+        return std::max<usize>((texture_count + columns - 1) / columns, 1);
+    }
+
+    static auto create_sphere(u32 segments, u32 rings) -> std::pair<std::vector<renderer::Vertex>, std::vector<u32>>
+    {
+        constexpr static auto radius = 0.8f;
+
+        auto vertices = std::vector<renderer::Vertex>{};
+        auto indices = std::vector<u32>{};
+
+        for (u32 ring = 0; ring <= rings; ring++)
+        {
+            const auto v = static_cast<f32>(ring) / static_cast<f32>(rings);
+            const auto phi = v * std::numbers::pi_v<f32>;
+
+            for (u32 segment = 0; segment <= segments; segment++)
+            {
+                const auto u = static_cast<f32>(segment) / static_cast<f32>(segments);
+                const auto theta = u * 2.0f * std::numbers::pi_v<f32>;
+                const auto normal = renderer::Vec3{ std::sin(phi) * std::cos(theta), std::cos(phi),
+                                                    std::sin(phi) * std::sin(theta) };
+
+                vertices.push_back(renderer::Vertex{
+                    .position = { normal[0] * radius, normal[1] * radius, normal[2] * radius },
+                    .normal = normal,
+                    .uv = { u, v },
+                });
+            }
+        }
+
+        // Counter-clockwise when seen from the outside.
+        for (u32 ring = 0; ring < rings; ring++)
+        {
+            for (u32 segment = 0; segment < segments; segment++)
+            {
+                const auto top = ring * (segments + 1) + segment;
+                const auto bottom = top + segments + 1;
+
+                indices.insert(indices.end(), { top, top + 1, bottom, top + 1, bottom + 1, bottom });
+            }
+        }
+
+        return { std::move(vertices), std::move(indices) };
+    }
+
+    static auto create_checkerboard(u32 size, u32 seed) -> std::vector<std::byte>
+    {
+        constexpr static u32 square_size = 32;
+
+        // Spread the colors of consecutive textures apart.
+        const auto color = std::array{ static_cast<std::byte>(64 + (seed * 67) % 192),
+                                       static_cast<std::byte>(64 + (seed * 131) % 192),
+                                       static_cast<std::byte>(64 + (seed * 199) % 192) };
+
+        auto pixels = std::vector<std::byte>(usize{ size } * size * 4);
+
+        for (u32 y = 0; y < size; y++)
+        {
+            for (u32 x = 0; x < size; x++)
+            {
+                const auto light = ((x / square_size) + (y / square_size)) % 2 == 0;
+                auto* pixel = &pixels[(usize{ y } * size + x) * 4];
+
+                pixel[0] = light ? color[0] : color[0] >> 1;
+                pixel[1] = light ? color[1] : color[1] >> 1;
+                pixel[2] = light ? color[2] : color[2] >> 1;
+                pixel[3] = std::byte{ 0xff };
+            }
+        }
+
+        return pixels;
+    }
+};
+
+} // namespace presenter
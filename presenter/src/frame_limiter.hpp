@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+#include "common.hpp"
+
+namespace presenter {
+
+// Paces frames to a target rate. The OS can oversleep by a millisecond or more, so we only sleep until shortly before
+// the deadline and spin for the rest of the time.
+class FrameLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // A target of 0 disables the limiter.
+    explicit FrameLimiter(f64 target_fps)
+        : _frame_duration{ target_fps > 0.0 ? std::chrono::duration_cast<Clock::duration>(
+                                                  std::chrono::duration<f64>{ 1.0 / target_fps })
+                                            : Clock::duration::zero() }
+    {}
+
+    // Should be called once per frame, after the frame has been submitted.
+    auto wait() -> void
+    {
+        if (_frame_duration == Clock::duration::zero())
+            return;
+
+        const auto now = Clock::now();
+
+        // Don't try to catch up if we fell behind by more than a frame (e.g. after idling), just start pacing again
+        // from now.
+        if (_next_deadline == Clock::time_point{} || now > _next_deadline + _frame_duration)
+        {
+            _next_deadline = now + _frame_duration;
+            return;
+        }
+
+        wait_until(_next_deadline);
+        _next_deadline += _frame_duration;
+    }
+
+private:
+    constexpr static auto spin_threshold = std::chrono::milliseconds{ 2 };
+
+    Clock::duration _frame_duration;
+    Clock::time_point _next_deadline{};
+
+private:
+    static auto wait_until(Clock::time_point deadline) -> void
+    {
+        if (const auto remaining = deadline - Clock::now(); remaining > spin_threshold)
+            std::this_thread::sleep_for(remaining - spin_threshold);
+
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+    }
+};
+
+} // namespace presenter
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <renderer/vulkan_renderer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+#include "assert.hpp"
+#include "common.hpp"
+#include "image_file.hpp"
+#include "log.hpp"
+
+namespace presenter {
+
+enum class CaptureFormat : u8
+{
+    Raw,
+    Ppm,
+    Png,
+};
+
+inline auto parse_capture_format(std::string_view name) -> std::optional<CaptureFormat>
+{
+    using enum CaptureFormat;
+
+    if (name == "raw")
+        return Raw;
+    if (name == "ppm")
+        return Ppm;
+    if (name == "png")
+        return Png;
+
+    return std::nullopt;
+}
+
+inline auto file_extension(CaptureFormat format) -> std::string_view
+{
+    switch (format)
+    {
+        using enum CaptureFormat;
+    case Raw:
+        return "raw";
+    case Ppm:
+        return "ppm";
+    case Png:
+        return "png";
+    }
+
+    PRESENTER_ASSERT(false);
+    return "";
+}
+
+// Streams frames read back from the renderer to disk (or to stdout) on a separate thread, so that the render loop only
+// pays for a memcpy per frame.
+class FrameWriter
+{
+public:
+    // Writes one file per frame into the output directory, or a single stream to stdout if the output is "-". Raw
+    // frames are written with their native pixel format and no header, which is what encoders reading from a pipe
+    // expect (e.g. ffmpeg -f rawvideo).
+    explicit FrameWriter(std::string output, CaptureFormat format, usize queue_capacity)
+        : _output{ std::move(output) }, _format{ format }, _queue_capacity{ queue_capacity },
+          _thread{ [this] { run(); } }
+    {}
+
+    ~FrameWriter() { finish(); }
+
+    FrameWriter(const FrameWriter&) = delete;
+    auto operator=(const FrameWriter&) = delete;
+    FrameWriter(FrameWriter&&) = delete;
+    auto operator=(FrameWriter&&) = delete;
+
+    // Blocks while the queue is full instead of dropping frames.
+    auto push(const renderer::ReadbackFrame& frame) -> void
+    {
+        auto lock = std::unique_lock{ _mutex };
+        _queue_not_full.wait(lock, [this] { return _queue.size() < _queue_capacity; });
+
+        auto pixels = std::vector<std::byte>{};
+
+        if (!_free_buffers.empty())
+        {
+            pixels = std::move(_free_buffers.back());
+            _free_buffers.pop_back();
+        }
+
+        lock.unlock();
+
+        pixels.assign(frame.pixels.begin(), frame.pixels.end());
+
+        lock.lock();
+        _queue.push_back(QueuedFrame{
+            .frame_number = frame.frame_number,
+            .width = frame.width,
+            .height = frame.height,
+            .format = frame.format,
+            .pixels = std::move(pixels),
+        });
+        lock.unlock();
+
+        _queue_not_empty.notify_one();
+    }
+
+    // Writes out everything that's still queued and stops the writer thread. Returns false if any write failed.
+    auto finish() -> bool
+    {
+        {
+            auto lock = std::scoped_lock{ _mutex };
+
+            if (_finished)
+                return !_failed;
+
+            _finished = true;
+        }
+
+        _queue_not_empty.notify_one();
+        _thread.join();
+
+        log_throughput("Capture finished");
+        return !_failed;
+    }
+
+    // Raw frames streamed to stdout have no header, so a reader can't follow a change of the frame size. The writer
+    // fails on the first frame with a different size instead of corrupting the stream.
+    [[nodiscard]] auto requires_fixed_frame_size() const -> bool
+    {
+        return _output == "-" && _format == CaptureFormat::Raw;
+    }
+
+    // Once a write failed, the remaining frames are dropped.
+    [[nodiscard]] auto failed() const -> bool { return _failed; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedFrame
+    {
+        u64 frame_number;
+        u32 width;
+        u32 height;
+        renderer::PixelFormat format;
+        std::vector<std::byte> pixels;
+    };
+
+    constexpr static auto throughput_report_interval = std::chrono::seconds{ 2 };
+
+    std::string _output;
+    CaptureFormat _format;
+    usize _queue_capacity;
+
+    std::mutex _mutex{};
+    std::condition_variable _queue_not_empty{};
+    std::condition_variable _queue_not_full{};
+    std::deque<QueuedFrame> _queue{};
+    // Pixel buffers of frames that have already been written, reused to avoid reallocating every frame.
+    std::vector<std::vector<std::byte>> _free_buffers{};
+    bool _finished{ false };
+
+    // Set by the writer thread, polled by the render loop.
+    std::atomic<bool> _failed{ false };
+
+    // Only accessed by the writer thread until it's joined.
+    std::FILE* _stdout{ nullptr };
+    std::vector<std::byte> _scratch{};
+    usize _frames_written{ 0 };
+    usize _bytes_written{ 0 };
+    u32 _frame_width{ 0 };
+    u32 _frame_height{ 0 };
+    Clock::time_point _start_time{};
+
+    // Declared last so that it's started after everything else is initialized.
+    std::thread _thread;
+
+private:
+    auto run() -> void
+    {
+        if (_output == "-")
+        {
+#if defined(_WIN32)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            _stdout = stdout;
+        }
+        else
+        {
+            auto error = std::error_code{};
+            std::filesystem::create_directories(_output, error);
+
+            if (error)
+            {
+                PRESENTER_ERROR("Failed to create capture directory {}: {}.", _output, error.message());
+                _failed = true;
+            }
+        }
+
+        _start_time = Clock::now();
+        auto last_report = _start_time;
+
+        while (true)
+        {
+            auto lock = std::unique_lock{ _mutex };
+            _queue_not_empty.wait(lock, [this] { return !_queue.empty() || _finished; });
+
+            if (_queue.empty())
+                break;
+
+            auto frame = std::move(_queue.front());
+            _queue.pop_front();
+            lock.unlock();
+
+            _queue_not_full.notify_one();
+
+            // Keep draining the queue after a failure so that the render loop doesn't block forever.
+            if (!_failed)
+                write(frame);
+
+            lock.lock();
+            _free_buffers.push_back(std::move(frame.pixels));
+            lock.unlock();
+
+            if (Clock::now() - last_report >= throughput_report_interval)
+            {
+                log_throughput("Capturing");
+                last_report = Clock::now();
+            }
+        }
+
+        if (_stdout)
+            std::fflush(_stdout);
+    }
+
+    auto write(QueuedFrame& frame) -> void
+    {
+        if (_frames_written == 0)
+        {
+            PRESENTER_INFO("Capturing {}x{} frames, pixel format {}.", frame.width, frame.height,
+                           frame.format == renderer::PixelFormat::Rgba8 ? "rgba" : "bgra");
+
+            _frame_width = frame.width;
+            _frame_height = frame.height;
+        }
+        else if (requires_fixed_frame_size() && (frame.width != _frame_width || frame.height != _frame_height))
+        {
+            PRESENTER_ERROR("Frame size changed from {}x{} to {}x{} while streaming raw frames, stopping the capture.",
+                            _frame_width, _frame_height, frame.width, frame.height);
+            _failed = true;
+            return;
+        }
+
+        if (_format != CaptureFormat::Raw && frame.format == renderer::PixelFormat::Bgra8)
+        {
+            for (usize i = 0; i + 3 < frame.pixels.size(); i += 4)
+                std::swap(frame.pixels[i], frame.pixels[i + 2]);
+        }
+
+        auto file = _stdout;
+
+        if (!file)
+        {
+            const auto path = std::filesystem::path{ _output }
+                              / std::format("frame_{:06}.{}", frame.frame_number, file_extension(_format));
+
+            file = std::fopen(path.string().c_str(), "wb");
+
+            if (!file)
+            {
+                PRESENTER_ERROR("Failed to open {} for writing.", path.string());
+                _failed = true;
+                return;
+            }
+        }
+
+        auto bytes_written = usize{ 0 };
+
+        switch (_format)
+        {
+            using enum CaptureFormat;
+        case Raw:
+            bytes_written = write_raw(file, frame.pixels);
+            break;
+        case Ppm:
+            bytes_written = write_ppm(file, frame.width, frame.height, frame.pixels, _scratch);
+            break;
+        case Png:
+            bytes_written = write_png(file, frame.width, frame.height, frame.pixels, _scratch);
+            break;
+        }
+
+        if (file != _stdout && std::fclose(file) != 0)
+            bytes_written = 0;
+
+        if (bytes_written == 0)
+        {
+            PRESENTER_ERROR("Failed to write frame {}.", frame.frame_number);
+            _failed = true;
+            return;
+        }
+
+        _frames_written++;
+        _bytes_written += bytes_written;
+    }
+
+    auto log_throughput(std::string_view label) const -> void
+    {
+        const auto seconds = std::chrono::duration<f64>{ Clock::now() - _start_time }.count();
+
+        if (seconds <= 0.0)
+            return;
+
+        PRESENTER_INFO("{}: {} frames, {:.1f} frames/s, {:.1f} MiB/s.", label, _frames_written,
+                       static_cast<f64>(_frames_written) / seconds,
+                       static_cast<f64>(_bytes_written) / (1024.0 * 1024.0) / seconds);
+    }
+};
+
+} // namespace presenter
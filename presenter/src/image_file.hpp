@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <format>
+#include <span>
+#include <vector>
+
+#include "common.hpp"
+
+namespace presenter {
+
+// Minimal encoders for captured frames. Pixels are expected to be tightly packed RGBA8. Every function returns the
+// number of bytes written, or 0 if writing failed.
+
+namespace image_file_detail {
+
+inline auto write_bytes(std::FILE* file, std::span<const std::byte> bytes) -> bool
+{
+    return std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+}
+
+inline auto append_u32_be(std::vector<std::byte>& out, u32 value) -> void
+{
+    out.push_back(static_cast<std::byte>(value >> 24));
+    out.push_back(static_cast<std::byte>(value >> 16));
+    out.push_back(static_cast<std::byte>(value >> 8));
+    out.push_back(static_cast<std::byte>(value));
+}
+
+inline auto crc32(std::span<const std::byte> bytes, u32 crc = 0) -> u32
+{
+    constexpr static auto table = [] {
+        auto table = std::array<u32, 256>{};
+
+        for (u32 i = 0; i < table.size(); i++)
+        {
+            auto value = i;
+
+            for (auto bit = 0; bit < 8; bit++)
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+
+            table[i] = value;
+        }
+
+        return table;
+    }();
+
+    crc = ~crc;
+
+    for (auto byte : bytes)
+        crc = table[(crc ^ static_cast<u32>(byte)) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+inline auto adler32(std::span<const std::byte> bytes, u32 adler = 1) -> u32
+{
+    constexpr static u32 modulus = 65521;
+    // Largest number of bytes that can be summed before the sums have to be reduced to avoid overflowing.
+    constexpr static usize max_run = 5552;
+
+    auto a = adler & 0xFFFF;
+    auto b = adler >> 16;
+
+    while (!bytes.empty())
+    {
+        const auto run = std::min(bytes.size(), max_run);
+
+        for (auto byte : bytes.first(run))
+        {
+            a += static_cast<u32>(byte);
+            b += a;
+        }
+
+        a %= modulus;
+        b %= modulus;
+        bytes = bytes.subspan(run);
+    }
+
+    return (b << 16) | a;
+}
+
+inline auto write_png_chunk(std::FILE* file, const char (&type)[5], std::span<const std::byte> data) -> bool
+{
+    auto header = std::vector<std::byte>{};
+    append_u32_be(header, static_cast<u32>(data.size()));
+
+    for (auto c : std::span{ type }.first(4))
+        header.push_back(static_cast<std::byte>(c));
+
+    auto crc = crc32(std::span{ header }.subspan(4));
+    crc = crc32(data, crc);
+
+    auto footer = std::vector<std::byte>{};
+    append_u32_be(footer, crc);
+
+    return write_bytes(file, header) && write_bytes(file, data) && write_bytes(file, footer);
+}
+
+} // namespace image_file_detail
+
+inline auto write_raw(std::FILE* file, std::span<const std::byte> pixels) -> usize
+{
+    return image_file_detail::write_bytes(file, pixels) ? pixels.size() : 0;
+}
+
+inline auto write_ppm(std::FILE* file, u32 width, u32 height, std::span<const std::byte> rgba,
+                      std::vector<std::byte>& scratch) -> usize
+{
+    const auto header = std::format("P6\n{} {}\n255\n", width, height);
+
+    scratch.resize(usize{ width } * height * 3);
+
+    for (usize i = 0, pixel_count = usize{ width } * height; i < pixel_count; i++)
+    {
+        scratch[i * 3 + 0] = rgba[i * 4 + 0];
+        scratch[i * 3 + 1] = rgba[i * 4 + 1];
+        scratch[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+
+    if (!image_file_detail::write_bytes(file, std::as_bytes(std::span{ header })))
+        return 0;
+
+    if (!image_file_detail::write_bytes(file, scratch))
+        return 0;
+
+    return header.size() + scratch.size();
+}
+
+// Writes the image data as stored (uncompressed) deflate blocks. Compression would make the writer thread the
+// bottleneck, and the files are usually fed to an encoder afterwards anyway.
+inline auto write_png(std::FILE* file, u32 width, u32 height, std::span<const std::byte> rgba,
+                      std::vector<std::byte>& scratch) -> usize
+{
+    using namespace image_file_detail;
+
+    constexpr static auto signature = std::array<u8, 8>{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    constexpr static usize max_stored_block_size = 0xFFFF;
+
+    auto ihdr = std::vector<std::byte>{};
+    append_u32_be(ihdr, width);
+    append_u32_be(ihdr, height);
+    ihdr.push_back(std::byte{ 8 }); // Bit depth.
+    ihdr.push_back(std::byte{ 6 }); // Color type: RGBA.
+    ihdr.push_back(std::byte{ 0 }); // Compression method.
+    ihdr.push_back(std::byte{ 0 }); // Filter method.
+    ihdr.push_back(std::byte{ 0 }); // Interlace method.
+
+    // Every row is prefixed with its filter type (0 - none).
+    const auto row_size = usize{ width } * 4;
+    auto filtered = std::vector<std::byte>{};
+    filtered.reserve((row_size + 1) * height);
+
+    for (usize row = 0; row < height; row++)
+    {
+        filtered.push_back(std::byte{ 0 });
+        filtered.insert(filtered.end(), rgba.begin() + static_cast<isize>(row * row_size),
+                        rgba.begin() + static_cast<isize>((row + 1) * row_size));
+    }
+
+    // zlib header: deflate with a 32K window, no preset dictionary, fastest compression level.
+    scratch.clear();
+    scratch.push_back(std::byte{ 0x78 });
+    scratch.push_back(std::byte{ 0x01 });
+
+    for (usize offset = 0; offset < filtered.size(); offset += max_stored_block_size)
+    {
+        const auto block_size = static_cast<u16>(std::min(filtered.size() - offset, max_stored_block_size));
+        const auto inverted_block_size = static_cast<u16>(~block_size);
+        const auto last = offset + block_size >= filtered.size();
+
+        scratch.push_back(std::byte{ last ? u8{ 1 } : u8{ 0 } });
+        scratch.push_back(static_cast<std::byte>(block_size & 0xFF));
+        scratch.push_back(static_cast<std::byte>(block_size >> 8));
+        scratch.push_back(static_cast<std::byte>(inverted_block_size & 0xFF));
+        scratch.push_back(static_cast<std::byte>(inverted_block_size >> 8));
+        scratch.insert(scratch.end(), filtered.begin() + static_cast<isize>(offset),
+                       filtered.begin() + static_cast<isize>(offset + block_size));
+    }
+
+    append_u32_be(scratch, adler32(filtered));
+
+    if (!write_bytes(file, std::as_bytes(std::span{ signature })))
+        return 0;
+
+    if (!write_png_chunk(file, "IHDR", ihdr) || !write_png_chunk(file, "IDAT", scratch)
+        || !write_png_chunk(file, "IEND", {}))
+    {
+        return 0;
+    }
+
+    // Signature, three chunks with 12 bytes of overhead each and their contents.
+    return signature.size() + 3 * 12 + ihdr.size() + scratch.size();
+}
+
+} // namespace presenter
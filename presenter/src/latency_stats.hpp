@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <vector>
+
+#include "assert.hpp"
+#include "common.hpp"
+
+namespace presenter {
+
+class LatencyStats
+{
+public:
+    using Duration = std::chrono::steady_clock::duration;
+
+    struct Summary
+    {
+        usize sample_count;
+        Duration min;
+        Duration average;
+        Duration p99;
+        Duration max;
+    };
+
+public:
+    auto record(Duration latency) -> void { _samples.push_back(latency); }
+    auto reset() -> void { _samples.clear(); }
+
+    [[nodiscard]] auto empty() const -> bool { return _samples.empty(); }
+
+    [[nodiscard]] auto summarize() -> Summary
+    {
+        PRESENTER_ASSERT(!_samples.empty());
+
+        std::ranges::sort(_samples);
+
+        const auto sample_count = _samples.size();
+        const auto total = std::accumulate(_samples.begin(), _samples.end(), Duration::zero());
+        const auto p99_index = std::min(sample_count - 1, sample_count * 99 / 100);
+
+        return Summary{
+            .sample_count = sample_count,
+            .min = _samples.front(),
+            .average = total / static_cast<Duration::rep>(sample_count),
+            .p99 = _samples[p99_index],
+            .max = _samples.back(),
+        };
+    }
+
+private:
+    std::vector<Duration> _samples{};
+};
+
+} // namespace presenter
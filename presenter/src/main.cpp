@@ -2,14 +2,29 @@
 #include <GLFW/glfw3.h>
 #include <renderer/log.hpp>
 #include <renderer/vulkan_renderer.hpp>
+#include <spdlog/fmt/ranges.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <charconv>
 #include <cstdlib>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 
 #include "assert.hpp"
+#include "common.hpp"
 #include "defer.hpp"
+#include "demo_scene.hpp"
+#include "frame_limiter.hpp"
+#include "frame_writer.hpp"
+#include "latency_stats.hpp"
 #include "log.hpp"
 
 namespace presenter {
@@ -42,12 +57,535 @@ auto renderer_log_callback(renderer::LogLevel level, std::string_view message) -
 
 const auto application_name = std::string{ "Renderer" };
 
-auto run() -> int
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    renderer::PresentMode present_mode{ renderer::PresentMode::Fifo };
+    // 0 means unlimited.
+    f64 fps_limit{ 0.0 };
+    // Only render when something changed (input, resize, expose) and block on events otherwise.
+    bool idle{ false };
+    // Periodically resizes the window and toggles fullscreen, then exits. Meant to be run under a virtual X server
+    // (e.g. xvfb-run) to check that swapchain recreation doesn't stall.
+    bool stress_resize{ false };
+    // Render into an offscreen image of this size instead of a window.
+    std::optional<std::array<u32, 2>> headless_size{ std::nullopt };
+    // Exit after rendering this many frames. 0 means no limit.
+    usize frame_limit{ 0 };
+    // Directory to write captured frames to, or "-" for stdout.
+    std::optional<std::string> capture_output{ std::nullopt };
+    CaptureFormat capture_format{ CaptureFormat::Ppm };
+    u32 readback_ring_size{ 3 };
+    u32 scene_textures{ 64 };
+    u32 scene_texture_size{ 512 };
+    u32 scene_lights{ 1024 };
+    // File to record the renderer calls to, for replaying them with the replayer.
+    std::optional<std::string> command_capture_output{ std::nullopt };
+};
+
+struct WindowState
+{
+    renderer::VulkanRenderer* renderer{ nullptr };
+    // Set while the window's size must not change (e.g. while streaming raw frames).
+    bool fixed_size{ false };
+    bool fullscreen{ false };
+    i32 windowed_x{ 0 };
+    i32 windowed_y{ 0 };
+    i32 windowed_width{ 0 };
+    i32 windowed_height{ 0 };
+    bool needs_redraw{ true };
+    // Time at which the oldest input event that hasn't been submitted for presentation yet was received.
+    std::optional<Clock::time_point> pending_input_time{ std::nullopt };
+};
+
+// A presented frame reflecting an input event, which is waited for to measure the input-to-present latency.
+struct PendingPresent
+{
+    u64 present_id;
+    Clock::time_point input_time;
+};
+
+auto parse_present_mode(std::string_view name) -> std::optional<renderer::PresentMode>
+{
+    using enum renderer::PresentMode;
+
+    if (name == "fifo")
+        return Fifo;
+    if (name == "fifo-relaxed")
+        return FifoRelaxed;
+    if (name == "mailbox")
+        return Mailbox;
+    if (name == "immediate")
+        return Immediate;
+
+    return std::nullopt;
+}
+
+template<typename T> auto parse_number(std::string_view string) -> std::optional<T>
+{
+    auto value = T{};
+
+    if (std::from_chars(string.data(), string.data() + string.size(), value).ec != std::errc{})
+        return std::nullopt;
+
+    return value;
+}
+
+auto parse_size(std::string_view string) -> std::optional<std::array<u32, 2>>
+{
+    const auto separator = string.find('x');
+
+    if (separator == std::string_view::npos)
+        return std::nullopt;
+
+    auto width = parse_number<u32>(string.substr(0, separator));
+    auto height = parse_number<u32>(string.substr(separator + 1));
+
+    if (!width || !height || *width == 0 || *height == 0)
+        return std::nullopt;
+
+    return std::array{ *width, *height };
+}
+
+auto parse_options(std::span<char* const> args) -> Options
+{
+    auto options = Options{};
+
+    for (usize i = 1; i < args.size(); i++)
+    {
+        const auto arg = std::string_view{ args[i] };
+        const auto has_value = i + 1 < args.size();
+
+        if (arg == "--stress-resize")
+        {
+            options.stress_resize = true;
+        }
+        else if (arg == "--idle")
+        {
+            options.idle = true;
+        }
+        else if (arg == "--present-mode" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto present_mode = parse_present_mode(value))
+                options.present_mode = *present_mode;
+            else
+                PRESENTER_WARN("Unknown present mode: {}.", value);
+        }
+        else if (arg == "--fps-limit" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto fps_limit = parse_number<f64>(value))
+                options.fps_limit = *fps_limit;
+            else
+                PRESENTER_WARN("Invalid frame rate limit: {}.", value);
+        }
+        else if (arg == "--headless" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto size = parse_size(value))
+                options.headless_size = *size;
+            else
+                PRESENTER_WARN("Invalid size: {}. Expected WIDTHxHEIGHT.", value);
+        }
+        else if (arg == "--frames" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto frame_limit = parse_number<usize>(value))
+                options.frame_limit = *frame_limit;
+            else
+                PRESENTER_WARN("Invalid frame count: {}.", value);
+        }
+        else if (arg == "--capture" && has_value)
+        {
+            options.capture_output = args[++i];
+        }
+        else if (arg == "--capture-format" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto capture_format = parse_capture_format(value))
+                options.capture_format = *capture_format;
+            else
+                PRESENTER_WARN("Unknown capture format: {}.", value);
+        }
+        else if (arg == "--readback-ring" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto ring_size = parse_number<u32>(value); ring_size && *ring_size > 0)
+                options.readback_ring_size = *ring_size;
+            else
+                PRESENTER_WARN("Invalid readback ring size: {}.", value);
+        }
+        else if (arg == "--scene-textures" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto texture_count = parse_number<u32>(value))
+                options.scene_textures = *texture_count;
+            else
+                PRESENTER_WARN("Invalid texture count: {}.", value);
+        }
+        else if (arg == "--texture-size" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto texture_size = parse_number<u32>(value); texture_size && *texture_size > 0)
+                options.scene_texture_size = *texture_size;
+            else
+                PRESENTER_WARN("Invalid texture size: {}.", value);
+        }
+        else if (arg == "--record-commands" && has_value)
+        {
+            options.command_capture_output = args[++i];
+        }
+        else if (arg == "--scene-lights" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto light_count = parse_number<u32>(value))
+                options.scene_lights = *light_count;
+            else
+                PRESENTER_WARN("Invalid light count: {}.", value);
+        }
+        else
+        {
+            PRESENTER_WARN("Unknown argument: {}.", arg);
+        }
+    }
+
+    return options;
+}
+
+auto window_state(GLFWwindow* window) -> WindowState&
+{
+    return *static_cast<WindowState*>(glfwGetWindowUserPointer(window));
+}
+
+auto on_input(GLFWwindow* window) -> void
+{
+    auto& state = window_state(window);
+    state.needs_redraw = true;
+
+    if (!state.pending_input_time)
+        state.pending_input_time = Clock::now();
+}
+
+auto toggle_fullscreen(GLFWwindow* window) -> void
+{
+    auto& state = window_state(window);
+
+    if (state.fixed_size)
+        return;
+
+    if (state.fullscreen)
+    {
+        glfwSetWindowMonitor(window, nullptr, state.windowed_x, state.windowed_y, state.windowed_width,
+                             state.windowed_height, GLFW_DONT_CARE);
+        state.fullscreen = false;
+        return;
+    }
+
+    auto monitor = glfwGetPrimaryMonitor();
+
+    if (!monitor)
+        return;
+
+    auto video_mode = glfwGetVideoMode(monitor);
+
+    glfwGetWindowPos(window, &state.windowed_x, &state.windowed_y);
+    glfwGetWindowSize(window, &state.windowed_width, &state.windowed_height);
+    glfwSetWindowMonitor(window, monitor, 0, 0, video_mode->width, video_mode->height, video_mode->refreshRate);
+    state.fullscreen = true;
+}
+
+auto framebuffer_size_callback(GLFWwindow* window, [[maybe_unused]] int width, [[maybe_unused]] int height) -> void
+{
+    auto& state = window_state(window);
+    state.renderer->notify_framebuffer_resized();
+    state.needs_redraw = true;
+}
+
+auto window_refresh_callback(GLFWwindow* window) -> void
+{
+    window_state(window).needs_redraw = true;
+}
+
+auto key_callback(GLFWwindow* window, int key, [[maybe_unused]] int scancode, int action, [[maybe_unused]] int mods)
+    -> void
+{
+    on_input(window);
+
+    if (key == GLFW_KEY_F11 && action == GLFW_PRESS)
+        toggle_fullscreen(window);
+}
+
+auto mouse_button_callback(GLFWwindow* window, [[maybe_unused]] int button, [[maybe_unused]] int action,
+                           [[maybe_unused]] int mods) -> void
+{
+    on_input(window);
+}
+
+auto cursor_pos_callback(GLFWwindow* window, [[maybe_unused]] double x, [[maybe_unused]] double y) -> void
+{
+    on_input(window);
+}
+
+auto scroll_callback(GLFWwindow* window, [[maybe_unused]] double x_offset, [[maybe_unused]] double y_offset) -> void
+{
+    on_input(window);
+}
+
+// Records the latency of every pending frame that has reached the screen, oldest first, waiting up to the timeout for
+// each of them. Frames that were discarded (e.g. by a swapchain recreation) aren't recorded.
+auto record_present_latencies(const renderer::VulkanRenderer& renderer, std::deque<PendingPresent>& pending_presents,
+                              LatencyStats& latency_stats, std::chrono::nanoseconds timeout) -> bool
+{
+    while (!pending_presents.empty())
+    {
+        const auto& pending_present = pending_presents.front();
+        const auto status = renderer.wait_for_present(pending_present.present_id, timeout);
+
+        if (!status)
+        {
+            PRESENTER_CRITICAL("Failed to wait for a frame to be presented: {}.", status.error());
+            return false;
+        }
+
+        if (*status == renderer::PresentStatus::Pending)
+            break;
+
+        if (*status == renderer::PresentStatus::Presented)
+            latency_stats.record(Clock::now() - pending_present.input_time);
+
+        pending_presents.pop_front();
+    }
+
+    return true;
+}
+
+auto log_latency_stats(const renderer::VulkanRenderer& renderer, LatencyStats& latency_stats) -> void
+{
+    if (latency_stats.empty())
+        return;
+
+    const auto summary = latency_stats.summarize();
+
+    auto to_ms = [](LatencyStats::Duration duration) {
+        return std::chrono::duration_cast<std::chrono::duration<f64, std::milli>>(duration).count();
+    };
+
+    // Without present wait, the time frames spend queued for presentation (which is where FIFO, mailbox and immediate
+    // differ the most) isn't measured, so the fallback is only a lower bound of the latency the user sees.
+    const auto label = renderer.supports_present_wait()
+                           ? "Input-to-present latency"
+                           : "Input-to-submit latency (fallback, VK_KHR_present_wait isn't supported)";
+
+    PRESENTER_INFO("{} ({} samples): min {:.2f} ms, avg {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms.", label,
+                   summary.sample_count, to_ms(summary.min), to_ms(summary.average), to_ms(summary.p99),
+                   to_ms(summary.max));
+
+    latency_stats.reset();
+}
+
+auto log_memory_stats(const renderer::VulkanRenderer& renderer) -> void
+{
+    const auto stats = renderer.memory_stats();
+
+    auto to_mib = [](vk::DeviceSize bytes) { return static_cast<f64>(bytes) / (1024.0 * 1024.0); };
+
+    PRESENTER_INFO("Streamed resources: {:.1f} MiB ({} mesh LODs, {} textures), {} uploads, {} evictions, {} memory "
+                   "blocks.",
+                   to_mib(stats.streamed_bytes), stats.resident_mesh_lods, stats.resident_textures, stats.uploads,
+                   stats.evictions, stats.memory_blocks);
+
+    for (usize i = 0; i < stats.heaps.size(); i++)
+    {
+        const auto& heap = stats.heaps[i];
+
+        if (!heap.device_local)
+            continue;
+
+        PRESENTER_INFO("Device-local heap {}: {:.1f} MiB used, {:.1f} MiB budget{}, {:.1f} MiB total.", i,
+                       to_mib(heap.usage), to_mib(heap.budget), stats.budget_extension_enabled ? "" : " (estimated)",
+                       to_mib(heap.size));
+    }
+}
+
+auto log_cluster_stats(const renderer::VulkanRenderer& renderer) -> void
+{
+    const auto stats = renderer.cluster_stats();
+    const auto cluster_count = stats.grid.x * stats.grid.y * stats.grid.z;
+
+    PRESENTER_INFO("Light clusters ({}x{}x{}): {} lights, {}/{} clusters occupied, {:.1f} avg and {} max lights per "
+                   "occupied cluster, {} overflowed.",
+                   stats.grid.x, stats.grid.y, stats.grid.z, stats.light_count, stats.occupied_clusters, cluster_count,
+                   stats.average_lights_per_occupied_cluster, stats.max_cluster_lights, stats.overflowed_clusters);
+    PRESENTER_INFO("Lights per cluster histogram (0, 1, 2-3, 4-7, ...): {}.", fmt::join(stats.histogram, ", "));
+}
+
+auto create_scene(renderer::VulkanRenderer& renderer, const Options& options) -> std::optional<DemoScene>
+{
+    auto scene =
+        DemoScene::create(renderer, options.scene_textures, options.scene_texture_size, options.scene_lights);
+
+    if (!scene)
+    {
+        PRESENTER_CRITICAL("Failed to create the scene: {}.", scene.error());
+        return std::nullopt;
+    }
+
+    return std::move(*scene);
+}
+
+// Has to be called before the scene is created, so that the recording includes its resources.
+auto start_command_capture(renderer::VulkanRenderer& renderer, const Options& options) -> bool
+{
+    if (!options.command_capture_output)
+        return true;
+
+    if (auto start_result = renderer.start_command_capture(*options.command_capture_output); !start_result)
+    {
+        PRESENTER_CRITICAL("Failed to start recording commands: {}.", start_result.error());
+        return false;
+    }
+
+    return true;
+}
+
+auto stop_command_capture(renderer::VulkanRenderer& renderer) -> bool
+{
+    if (!renderer.is_capturing_commands())
+        return true;
+
+    if (auto stop_result = renderer.stop_command_capture(); !stop_result)
+    {
+        PRESENTER_ERROR("Failed to record commands: {}.", stop_result.error());
+        return false;
+    }
+
+    return true;
+}
+
+// Returns null if capturing wasn't requested or couldn't be started.
+auto start_capture(renderer::VulkanRenderer& renderer, const Options& options) -> std::unique_ptr<FrameWriter>
+{
+    if (!options.capture_output)
+        return nullptr;
+
+    constexpr static usize frame_writer_queue_capacity = 8;
+
+    auto frame_writer =
+        std::make_unique<FrameWriter>(*options.capture_output, options.capture_format, frame_writer_queue_capacity);
+
+    auto enable_readback_result = renderer.enable_frame_readback(
+        options.readback_ring_size,
+        [frame_writer = frame_writer.get()](const renderer::ReadbackFrame& frame) { frame_writer->push(frame); });
+
+    if (!enable_readback_result)
+    {
+        PRESENTER_CRITICAL("Failed to enable frame readback: {}.", enable_readback_result.error());
+        return nullptr;
+    }
+
+    return frame_writer;
+}
+
+auto finish_capture(renderer::VulkanRenderer& renderer, FrameWriter& frame_writer) -> bool
+{
+    if (auto disable_readback_result = renderer.disable_frame_readback(); !disable_readback_result)
+    {
+        PRESENTER_ERROR("Failed to read back the remaining frames: {}.", disable_readback_result.error());
+        frame_writer.finish();
+        return false;
+    }
+
+    return frame_writer.finish();
+}
+
+auto run_headless(const Options& options) -> int
+{
+    const auto [width, height] = *options.headless_size;
+
+    auto renderer = renderer::VulkanRenderer::create_headless(application_name.c_str(), width, height);
+
+    if (!renderer)
+    {
+        PRESENTER_CRITICAL("Failed to initialize the renderer: {}.", renderer.error());
+        return EXIT_FAILURE;
+    }
+
+    if (!start_command_capture(*renderer, options))
+        return EXIT_FAILURE;
+
+    auto scene = create_scene(*renderer, options);
+
+    if (!scene)
+        return EXIT_FAILURE;
+
+    auto frame_writer = start_capture(*renderer, options);
+
+    if (options.capture_output && !frame_writer)
+        return EXIT_FAILURE;
+
+    // Animate with a fixed time step, so that the rendered frames don't depend on how fast they were rendered.
+    constexpr static auto headless_time_step = 1.0 / 60.0;
+
+    const auto aspect_ratio = static_cast<f32>(width) / static_cast<f32>(height);
+    auto frame_limiter = FrameLimiter{ options.fps_limit };
+    const auto start_time = Clock::now();
+    auto frame_count = usize{ 0 };
+
+    while (options.frame_limit == 0 || frame_count < options.frame_limit)
+    {
+        scene->draw(*renderer, static_cast<f64>(frame_count) * headless_time_step, aspect_ratio);
+
+        if (auto render_frame_result = renderer->render_frame(); !render_frame_result)
+        {
+            PRESENTER_CRITICAL("Failed to render a frame: {}.", render_frame_result.error());
+            return EXIT_FAILURE;
+        }
+
+        frame_count++;
+        frame_limiter.wait();
+    }
+
+    if (frame_writer && !finish_capture(*renderer, *frame_writer))
+        return EXIT_FAILURE;
+
+    if (!stop_command_capture(*renderer))
+        return EXIT_FAILURE;
+
+    const auto seconds = std::chrono::duration<f64>{ Clock::now() - start_time }.count();
+    PRESENTER_INFO("Rendered {} frames in {:.2f} s ({:.1f} frames/s).", frame_count, seconds,
+                   static_cast<f64>(frame_count) / seconds);
+    log_memory_stats(*renderer);
+    log_cluster_stats(*renderer);
+
+    return EXIT_SUCCESS;
+}
+
+auto run(const Options& options) -> int
 {
     // There's a bug in VS runtime that can cause the application to deadlock when it exits when using asynchronous
     // loggers. Calling spdlog::shutdown() prevents that.
     Defer shutdown_spdlog{ [] { spdlog::shutdown(); } };
 
+    // Frames are streamed through stdout, so logs have to go somewhere else.
+    if (options.capture_output == "-")
+        spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+
+    renderer::register_log_callback(renderer_log_callback);
+
+    if (options.headless_size)
+        return run_headless(options);
+
     glfwSetErrorCallback(glfw_error_callback);
 
     if (!glfwInit())
@@ -59,8 +597,6 @@ auto run() -> int
     Defer terminate_glfw{ [] { glfwTerminate(); } };
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    // Handling resizable windows takes special care, so disable resizing for now.
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
     auto window = glfwCreateWindow(1920, 1080, application_name.c_str(), nullptr, nullptr);
 
@@ -75,9 +611,7 @@ auto run() -> int
     // glfwMakeContextCurrent(window);
     // glfwSwapInterval(1);
 
-    renderer::register_log_callback(renderer_log_callback);
-
-    auto renderer = renderer::VulkanRenderer::create_glfw(application_name.c_str(), window);
+    auto renderer = renderer::VulkanRenderer::create_glfw(application_name.c_str(), window, options.present_mode);
 
     if (!renderer)
     {
@@ -85,12 +619,174 @@ auto run() -> int
         return EXIT_FAILURE;
     }
 
+    if (!start_command_capture(*renderer, options))
+        return EXIT_FAILURE;
+
+    auto scene = create_scene(*renderer, options);
+
+    if (!scene)
+        return EXIT_FAILURE;
+
+    auto frame_writer = start_capture(*renderer, options);
+
+    if (options.capture_output && !frame_writer)
+        return EXIT_FAILURE;
+
+    // Raw frames streamed to stdout can't change size, so the window can't either.
+    const auto fixed_window_size = frame_writer && frame_writer->requires_fixed_frame_size();
+
+    if (fixed_window_size)
+    {
+        if (options.stress_resize)
+        {
+            PRESENTER_CRITICAL("--stress-resize can't be combined with streaming raw frames to stdout.");
+            return EXIT_FAILURE;
+        }
+
+        glfwSetWindowAttrib(window, GLFW_RESIZABLE, GLFW_FALSE);
+    }
+
+    auto state = WindowState{ .renderer = &*renderer, .fixed_size = fixed_window_size };
+    glfwSetWindowUserPointer(window, &state);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetCursorPosCallback(window, cursor_pos_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+
+    constexpr static auto stress_resize_sizes = std::array{ std::array{ 1920, 1080 }, std::array{ 1280, 720 },
+                                                            std::array{ 640, 480 }, std::array{ 1600, 900 } };
+    constexpr static usize stress_resize_interval = 30;
+    constexpr static usize stress_resize_frames = 1200;
+
+    // Upper bound on how long we block waiting for events in idle mode, so that periodic work (like reporting stats)
+    // still happens.
+    constexpr static auto idle_wait_timeout = 0.5;
+    constexpr static auto present_wait_idle_timeout = std::chrono::milliseconds{ 100 };
+    constexpr static auto stats_report_interval = std::chrono::seconds{ 5 };
+
+    auto frame_limiter = FrameLimiter{ options.fps_limit };
+    auto latency_stats = LatencyStats{};
+    auto pending_presents = std::deque<PendingPresent>{};
+    auto last_stats_report = Clock::now();
+
+    auto frame_count = usize{ 0 };
+    auto worst_frame_time = Clock::duration::zero();
+    const auto start_time = Clock::now();
+
     while (!glfwWindowShouldClose(window))
     {
-        // glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (glfwGetWindowAttrib(window, GLFW_ICONIFIED))
+            glfwWaitEvents();
+        else if (options.idle && !state.needs_redraw)
+            glfwWaitEventsTimeout(idle_wait_timeout);
+        else
+            glfwPollEvents();
+
+        if (Clock::now() - last_stats_report >= stats_report_interval)
+        {
+            log_latency_stats(*renderer, latency_stats);
+            log_memory_stats(*renderer);
+            log_cluster_stats(*renderer);
+            last_stats_report = Clock::now();
+        }
+
+        if (options.idle && !state.needs_redraw)
+            continue;
+
+        state.needs_redraw = false;
+
+        const auto frame_start = Clock::now();
+
+        int framebuffer_width = 0;
+        int framebuffer_height = 0;
+        glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+
+        // Nothing gets rendered while minimized, but the draws still have to be valid.
+        const auto aspect_ratio = framebuffer_height > 0 ? static_cast<f32>(framebuffer_width)
+                                                               / static_cast<f32>(framebuffer_height)
+                                                         : 1.0f;
+
+        scene->draw(*renderer, std::chrono::duration<f64>{ frame_start - start_time }.count(), aspect_ratio);
+
+        const auto previous_present_id = renderer->last_present_id();
+
+        if (auto render_frame_result = renderer->render_frame(); !render_frame_result)
+        {
+            PRESENTER_CRITICAL("Failed to render a frame: {}.", render_frame_result.error());
+            return EXIT_FAILURE;
+        }
+
+        const auto frame_end = Clock::now();
+
+        // Measured from the moment GLFW delivered the event to the moment the frame reflecting it is on screen. If
+        // nothing was presented (e.g. while the swapchain is out of date), the input stays pending for the next frame.
+        // Without present wait, we fall back to the moment vkQueuePresentKHR() returned.
+        if (state.pending_input_time && !renderer->supports_present_wait())
+        {
+            latency_stats.record(frame_end - *state.pending_input_time);
+            state.pending_input_time = std::nullopt;
+        }
+        else if (state.pending_input_time && renderer->last_present_id() != previous_present_id)
+        {
+            pending_presents.push_back(
+                PendingPresent{ .present_id = renderer->last_present_id(), .input_time = *state.pending_input_time });
+            state.pending_input_time = std::nullopt;
+        }
+
+        // Polled once per frame, which may add up to a frame to the measured latency. In idle mode nothing else
+        // happens until the next event, so we block (for a bounded time) until the frame is on screen instead.
+        const auto present_wait_timeout = options.idle ? std::chrono::nanoseconds{ present_wait_idle_timeout }
+                                                       : std::chrono::nanoseconds::zero();
+
+        if (renderer->supports_present_wait()
+            && !record_present_latencies(*renderer, pending_presents, latency_stats, present_wait_timeout))
+        {
+            return EXIT_FAILURE;
+        }
+
+        worst_frame_time = std::max(worst_frame_time, frame_end - frame_start);
+        frame_count++;
+
+        if (options.stress_resize && frame_count % stress_resize_interval == 0)
+        {
+            const auto step = frame_count / stress_resize_interval;
+
+            if (step % 8 == 0)
+            {
+                toggle_fullscreen(window);
+            }
+            else if (!state.fullscreen)
+            {
+                const auto [width, height] = stress_resize_sizes[step % stress_resize_sizes.size()];
+                glfwSetWindowSize(window, width, height);
+            }
+
+            if (frame_count >= stress_resize_frames)
+                glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+
+        if (options.frame_limit != 0 && frame_count >= options.frame_limit)
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+        // The window may still have been resized by the window manager, in which case the writer stops.
+        if (frame_writer && frame_writer->failed())
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+        frame_limiter.wait();
     }
 
+    if (frame_writer && !finish_capture(*renderer, *frame_writer))
+        return EXIT_FAILURE;
+
+    if (!stop_command_capture(*renderer))
+        return EXIT_FAILURE;
+
+    log_latency_stats(*renderer, latency_stats);
+    PRESENTER_INFO("Rendered {} frames, worst frame time: {} us.", frame_count,
+                   std::chrono::duration_cast<std::chrono::microseconds>(worst_frame_time).count());
+
     return EXIT_SUCCESS;
 }
 
@@ -98,7 +794,7 @@ auto run() -> int
 
 } // namespace presenter
 
-auto main() -> int
+auto main(int argc, char* argv[]) -> int
 {
-    return presenter::run();
+    return presenter::run(presenter::parse_options(std::span{ argv, static_cast<presenter::usize>(argc) }));
 }
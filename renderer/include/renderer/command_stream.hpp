@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <expected>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "renderer/common.hpp"
+#include "renderer/math.hpp"
+
+namespace renderer {
+
+struct MeshLod;
+struct Camera;
+struct PointLight;
+enum class MeshHandle : u32;
+enum class TextureHandle : u32;
+class VulkanRenderer;
+
+// A command stream is a compact binary recording of the calls made to a VulkanRenderer: resource creation (with the
+// mesh and texture data), draws, lights, camera updates and frame boundaries. Replaying it drives a renderer through
+// the same work, which turns a captured workload into a repeatable benchmark.
+//
+// The file starts with a header (magic, version, render target size), followed by one record per call: an opcode byte
+// and its arguments. Integers such as handles and counts are stored as LEB128 varints, floats and bulk data as raw
+// little-endian bytes.
+class CommandStreamWriter
+{
+public:
+    [[nodiscard]] static auto create(const std::filesystem::path& path, u32 width, u32 height)
+        -> std::expected<CommandStreamWriter, std::string>;
+
+    // Creation is only recorded when it succeeded, along with the handle it returned, so that the replay can map the
+    // recorded handles to its own.
+    auto create_mesh(std::span<const MeshLod> lods, MeshHandle mesh) -> void;
+    auto destroy_mesh(MeshHandle mesh) -> void;
+    auto create_texture(u32 width, u32 height, std::span<const std::byte> pixels, TextureHandle texture) -> void;
+    auto destroy_texture(TextureHandle texture) -> void;
+    auto set_camera(const Camera& camera) -> void;
+    auto submit_draw(MeshHandle mesh, u32 lod, const Mat4& transform, std::optional<TextureHandle> texture) -> void;
+    auto submit_light(const PointLight& light) -> void;
+    auto set_eviction_watermarks(f32 high_watermark, f32 low_watermark) -> void;
+    auto render_frame() -> void;
+
+    // Writes out the buffered records. Write errors are reported here rather than by the recording functions.
+    [[nodiscard]] auto finish() -> std::expected<void, std::string>;
+
+    [[nodiscard]] auto frame_count() const -> u64 { return _frame_count; }
+    [[nodiscard]] auto size() const -> u64 { return _written_size + _buffer.size(); }
+
+private:
+    // Records are collected in memory and written in large chunks, so that recording a draw stays cheap.
+    constexpr static usize flush_threshold = usize{ 1 } << 20;
+
+    std::filesystem::path _path;
+    std::ofstream _file;
+    std::vector<std::byte> _buffer{};
+    u64 _written_size{ 0 };
+    u64 _frame_count{ 0 };
+
+private:
+    CommandStreamWriter(std::filesystem::path path, std::ofstream file);
+
+    auto flush_if_full() -> void;
+    auto flush() -> void;
+};
+
+struct ReplayStats
+{
+    u64 frame_count;
+    u64 command_count;
+    // Wall time of the whole replay, including resource creation, until the GPU has finished the last frame.
+    std::chrono::nanoseconds duration;
+    // Time spent in VulkanRenderer::render_frame().
+    std::chrono::nanoseconds min_frame_time;
+    std::chrono::nanoseconds average_frame_time;
+    std::chrono::nanoseconds max_frame_time;
+};
+
+class CommandStream
+{
+public:
+    // Reads the whole file up front, so that the replay isn't slowed down by disk reads.
+    [[nodiscard]] static auto load(const std::filesystem::path& path) -> std::expected<CommandStream, std::string>;
+
+    // Size of the render target the stream was recorded with.
+    [[nodiscard]] auto width() const -> u32 { return _width; }
+    [[nodiscard]] auto height() const -> u32 { return _height; }
+
+    // Issues the recorded calls as fast as possible. Recorded handles are mapped to the ones returned by the renderer,
+    // so it may already hold other resources. Resources the stream didn't destroy are destroyed at the end, even if the
+    // replay fails, so the same stream can be replayed repeatedly on one renderer.
+    [[nodiscard]] auto replay(VulkanRenderer& renderer) const -> std::expected<ReplayStats, std::string>;
+
+private:
+    std::vector<std::byte> _data;
+    usize _commands_offset;
+    u32 _width;
+    u32 _height;
+
+private:
+    CommandStream(std::vector<std::byte> data, usize commands_offset, u32 width, u32 height);
+};
+
+} // namespace renderer
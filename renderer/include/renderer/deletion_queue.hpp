@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "renderer/common.hpp"
+
+namespace renderer {
+
+// Keeps objects (usually vk::raii handles) alive until the GPU timeline reaches the value of the last submission that
+// referenced them. Objects are retired in order of their timeline value, and in the order they were pushed for equal
+// values, so an object that has to outlive later submissions doesn't hold back the ones pushed after it.
+class DeletionQueue
+{
+public:
+    template<typename T>
+        requires(!std::is_lvalue_reference_v<T>)
+    auto push(T&& object, u64 timeline_value) -> void
+    {
+        // Values are almost always pushed in increasing order, so the search rarely goes further than the last entry.
+        auto position = std::ranges::find_if(_entries.rbegin(), _entries.rend(), [timeline_value](const Entry& entry) {
+                            return entry.timeline_value <= timeline_value;
+                        }).base();
+
+        _entries.insert(position, Entry{
+                                      .timeline_value = timeline_value,
+                                      .object = std::make_unique<Holder<std::remove_cvref_t<T>>>(std::move(object)),
+                                  });
+    }
+
+    // Destroys objects whose timeline value has been reached until the time budget runs out. At least one object is
+    // destroyed if any is ready, so the queue always makes progress. Returns the number of destroyed objects.
+    auto process(u64 completed_timeline_value, std::chrono::nanoseconds time_budget) -> usize;
+
+    [[nodiscard]] auto size() const -> usize { return _entries.size(); }
+    [[nodiscard]] auto empty() const -> bool { return _entries.empty(); }
+
+private:
+    struct HolderBase
+    {
+        HolderBase() = default;
+        virtual ~HolderBase() = default;
+
+        HolderBase(const HolderBase&) = delete;
+        auto operator=(const HolderBase&) = delete;
+        HolderBase(HolderBase&&) = delete;
+        auto operator=(HolderBase&&) = delete;
+    };
+
+    template<typename T> struct Holder final : HolderBase
+    {
+        explicit Holder(T&& value) : object{ std::move(value) } {}
+
+        T object;
+    };
+
+    struct Entry
+    {
+        u64 timeline_value;
+        std::unique_ptr<HolderBase> object;
+    };
+
+    std::deque<Entry> _entries{};
+};
+
+} // namespace renderer
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+#include "renderer/common.hpp"
+
+namespace renderer {
+
+using Vec2 = std::array<f32, 2>;
+using Vec3 = std::array<f32, 3>;
+using Vec4 = std::array<f32, 4>;
+
+// Column-major, like in GLSL.
+using Mat4 = std::array<f32, 16>;
+
+namespace math {
+
+[[nodiscard]] constexpr auto dot(const Vec3& a, const Vec3& b) -> f32
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+[[nodiscard]] constexpr auto cross(const Vec3& a, const Vec3& b) -> Vec3
+{
+    return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+}
+
+[[nodiscard]] inline auto normalize(const Vec3& v) -> Vec3
+{
+    const auto length = std::sqrt(dot(v, v));
+    return { v[0] / length, v[1] / length, v[2] / length };
+}
+
+[[nodiscard]] constexpr auto identity() -> Mat4
+{
+    return { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+}
+
+[[nodiscard]] constexpr auto multiply(const Mat4& a, const Mat4& b) -> Mat4
+{
+    auto result = Mat4{};
+
+    for (usize column = 0; column < 4; column++)
+    {
+        for (usize row = 0; row < 4; row++)
+        {
+            auto sum = 0.0f;
+
+            for (usize i = 0; i < 4; i++)
+                sum += a[i * 4 + row] * b[column * 4 + i];
+
+            result[column * 4 + row] = sum;
+        }
+    }
+
+    return result;
+}
+
+[[nodiscard]] constexpr auto transform_point(const Mat4& m, const Vec3& p) -> Vec3
+{
+    return { m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12], m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+             m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14] };
+}
+
+[[nodiscard]] constexpr auto translation(const Vec3& offset) -> Mat4
+{
+    auto result = identity();
+    result[12] = offset[0];
+    result[13] = offset[1];
+    result[14] = offset[2];
+    return result;
+}
+
+[[nodiscard]] constexpr auto scale(const Vec3& factors) -> Mat4
+{
+    auto result = identity();
+    result[0] = factors[0];
+    result[5] = factors[1];
+    result[10] = factors[2];
+    return result;
+}
+
+[[nodiscard]] inline auto rotation_y(f32 angle) -> Mat4
+{
+    auto result = identity();
+    result[0] = std::cos(angle);
+    result[2] = -std::sin(angle);
+    result[8] = std::sin(angle);
+    result[10] = std::cos(angle);
+    return result;
+}
+
+// Right-handed view space looking down -Z.
+[[nodiscard]] inline auto look_at(const Vec3& eye, const Vec3& target, const Vec3& up) -> Mat4
+{
+    const auto forward = normalize({ target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] });
+    const auto side = normalize(cross(forward, up));
+    const auto camera_up = cross(side, forward);
+
+    return { side[0],         camera_up[0],         -forward[0],       0.0f, //
+             side[1],         camera_up[1],         -forward[1],       0.0f, //
+             side[2],         camera_up[2],         -forward[2],       0.0f, //
+             -dot(side, eye), -dot(camera_up, eye), dot(forward, eye), 1.0f };
+}
+
+// Maps view space depth to Vulkan's [0, 1] depth range and flips Y, since Vulkan's clip space Y points down.
+[[nodiscard]] inline auto perspective(f32 vertical_fov, f32 aspect_ratio, f32 near_plane, f32 far_plane) -> Mat4
+{
+    const auto focal_length = 1.0f / std::tan(vertical_fov / 2.0f);
+
+    auto result = Mat4{};
+    result[0] = focal_length / aspect_ratio;
+    result[5] = -focal_length;
+    result[10] = far_plane / (near_plane - far_plane);
+    result[11] = -1.0f;
+    result[14] = near_plane * far_plane / (near_plane - far_plane);
+    return result;
+}
+
+} // namespace math
+
+} // namespace renderer
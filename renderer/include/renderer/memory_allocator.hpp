@@ -0,0 +1,156 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include <array>
+#include <cstddef>
+#include <expected>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "renderer/common.hpp"
+
+namespace renderer {
+
+class MemoryAllocation;
+
+// Suballocates buffers and images from large blocks of device memory, one set of blocks per memory type, so that the
+// number of vkAllocateMemory calls stays far below maxMemoryAllocationCount. Resources larger than half a block get a
+// dedicated block. Linear (buffers) and optimal (images) resources never share a block, so bufferImageGranularity
+// doesn't have to be respected between neighbouring ranges. Host-visible blocks stay mapped for their whole lifetime.
+//
+// Allocations point back at the allocator, so it has to stay at the same address and outlive them.
+class MemoryAllocator
+{
+public:
+    constexpr static vk::DeviceSize default_block_size = vk::DeviceSize{ 64 } << 20;
+
+    MemoryAllocator(const vk::PhysicalDeviceMemoryProperties& memory_properties, vk::DeviceSize non_coherent_atom_size);
+    ~MemoryAllocator();
+
+    MemoryAllocator(const MemoryAllocator&) = delete;
+    auto operator=(const MemoryAllocator&) = delete;
+    MemoryAllocator(MemoryAllocator&&) = delete;
+    auto operator=(MemoryAllocator&&) = delete;
+
+    [[nodiscard]] auto allocate(const vk::raii::Device& device, const vk::MemoryRequirements& requirements,
+                                u32 memory_type_index, bool optimal_tiling)
+        -> std::expected<MemoryAllocation, std::string>;
+
+    // Marks memory that's about to be freed, like that of an evicted resource waiting in the deletion queue. It's
+    // counted by retired_bytes() until the allocation is actually destroyed.
+    auto retire(MemoryAllocation& allocation) -> void;
+
+    // Makes GPU writes to non-coherent memory visible to the host. Does nothing for host-coherent memory.
+    [[nodiscard]] auto invalidate(const vk::raii::Device& device, const MemoryAllocation& allocation) const
+        -> std::expected<void, std::string>;
+
+    // Device memory allocated from the heap, including the unused parts of its blocks.
+    [[nodiscard]] auto reserved_bytes(u32 heap_index) const -> vk::DeviceSize;
+    // Bytes of the heap's blocks that are handed out to allocations, including retired ones.
+    [[nodiscard]] auto allocated_bytes(u32 heap_index) const -> vk::DeviceSize;
+    [[nodiscard]] auto retired_bytes(u32 heap_index) const -> vk::DeviceSize;
+    // How much device memory allocating a resource of the given size would add: nothing if it fits into a free range of
+    // an existing block, otherwise a new block. Only an estimate, since the alignment isn't known up front.
+    [[nodiscard]] auto expected_growth(u32 memory_type_index, bool optimal_tiling, vk::DeviceSize size) const
+        -> vk::DeviceSize;
+    // Number of vkAllocateMemory allocations currently alive.
+    [[nodiscard]] auto block_count() const -> usize { return _block_count; }
+
+private:
+    friend class MemoryAllocation;
+
+    struct Range
+    {
+        vk::DeviceSize offset;
+        vk::DeviceSize size;
+    };
+
+    struct Block
+    {
+        vk::raii::DeviceMemory memory{ nullptr };
+        vk::DeviceSize size{ 0 };
+        std::byte* mapped{ nullptr };
+        u32 pool_index{ 0 };
+        u32 heap_index{ 0 };
+        vk::MemoryPropertyFlags property_flags{};
+        bool dedicated{ false };
+        // Sorted by offset. Adjacent ranges are always merged.
+        std::vector<Range> free_ranges{};
+        vk::DeviceSize allocated_bytes{ 0 };
+    };
+
+    // Blocks of one memory type that hold either linear or optimal resources.
+    struct Pool
+    {
+        std::vector<std::unique_ptr<Block>> blocks{};
+    };
+
+    vk::PhysicalDeviceMemoryProperties _memory_properties;
+    vk::DeviceSize _non_coherent_atom_size;
+    // Indexed by memory type * 2 + optimal tiling.
+    std::array<Pool, vk::MaxMemoryTypes * 2> _pools{};
+    // The following are indexed by memory heap.
+    std::array<vk::DeviceSize, vk::MaxMemoryHeaps> _reserved_bytes{};
+    std::array<vk::DeviceSize, vk::MaxMemoryHeaps> _allocated_bytes{};
+    std::array<vk::DeviceSize, vk::MaxMemoryHeaps> _retired_bytes{};
+    usize _block_count{ 0 };
+
+private:
+    [[nodiscard]] auto create_block(const vk::raii::Device& device, u32 memory_type_index, u32 pool_index,
+                                    vk::DeviceSize size, bool dedicated) -> std::expected<Block*, std::string>;
+    // Returns nullopt if the block doesn't have a large enough free range.
+    [[nodiscard]] auto allocate_from_block(Block& block, vk::DeviceSize size, vk::DeviceSize alignment)
+        -> std::optional<MemoryAllocation>;
+    auto free(Block& block, vk::DeviceSize offset, vk::DeviceSize size, bool retired) -> void;
+    auto destroy_block(Block& block) -> void;
+    [[nodiscard]] auto block_size(u32 heap_index) const -> vk::DeviceSize;
+};
+
+// A range of a MemoryAllocator block, returned to the allocator when destroyed. Default constructed and moved-from
+// allocations are empty.
+class MemoryAllocation
+{
+public:
+    MemoryAllocation() = default;
+    ~MemoryAllocation();
+
+    MemoryAllocation(const MemoryAllocation&) = delete;
+    auto operator=(const MemoryAllocation&) = delete;
+    MemoryAllocation(MemoryAllocation&& other) noexcept;
+    auto operator=(MemoryAllocation&& other) noexcept -> MemoryAllocation&;
+
+    [[nodiscard]] auto memory() const -> vk::DeviceMemory { return _block ? *_block->memory : vk::DeviceMemory{}; }
+    [[nodiscard]] auto offset() const -> vk::DeviceSize { return _offset; }
+    [[nodiscard]] auto size() const -> vk::DeviceSize { return _size; }
+    [[nodiscard]] auto heap_index() const -> u32 { return _block ? _block->heap_index : 0; }
+    [[nodiscard]] auto property_flags() const -> vk::MemoryPropertyFlags
+    {
+        return _block ? _block->property_flags : vk::MemoryPropertyFlags{};
+    }
+    // Null unless the memory is host-visible.
+    [[nodiscard]] auto mapped() const -> std::byte*
+    {
+        return _block && _block->mapped ? _block->mapped + _offset : nullptr;
+    }
+
+private:
+    friend class MemoryAllocator;
+
+    MemoryAllocator* _allocator{ nullptr };
+    MemoryAllocator::Block* _block{ nullptr };
+    vk::DeviceSize _offset{ 0 };
+    vk::DeviceSize _size{ 0 };
+    bool _retired{ false };
+
+private:
+    MemoryAllocation(MemoryAllocator* allocator, MemoryAllocator::Block* block, vk::DeviceSize offset,
+                     vk::DeviceSize size);
+
+    auto reset() -> void;
+};
+
+} // namespace renderer
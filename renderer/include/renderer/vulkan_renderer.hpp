@@ -5,27 +5,469 @@
 #include <vulkan/vulkan_raii.hpp>
 
 #include <array>
+#include <chrono>
+#include <cstddef>
 #include <expected>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <span>
 #include <string>
+#include <string_view>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
+#include "renderer/command_stream.hpp"
 #include "renderer/common.hpp"
+#include "renderer/deletion_queue.hpp"
+#include "renderer/math.hpp"
+#include "renderer/memory_allocator.hpp"
 
 namespace renderer {
 
+enum class PresentMode : u8
+{
+    // Vsync, never tears. Always supported.
+    Fifo,
+    // Vsync, but tears instead of waiting when a frame misses the vertical blank.
+    FifoRelaxed,
+    // Low latency without tearing. Frames that weren't presented in time get replaced by newer ones.
+    Mailbox,
+    // Lowest latency, tears.
+    Immediate,
+};
+
+[[nodiscard]] auto to_string(PresentMode present_mode) -> std::string_view;
+
+enum class PresentStatus : u8
+{
+    // Queued, but not on screen yet.
+    Pending,
+    // On screen, or replaced by a later frame that is.
+    Presented,
+    // Never going to be shown, e.g. because the swapchain it was presented to has been replaced.
+    Discarded,
+};
+
+enum class PixelFormat : u8
+{
+    Rgba8,
+    Bgra8,
+};
+
+struct ReadbackFrame
+{
+    u64 frame_number;
+    u32 width;
+    u32 height;
+    PixelFormat format;
+    // Tightly packed rows, 4 bytes per pixel. Only valid for the duration of the callback.
+    std::span<const std::byte> pixels;
+};
+
+using ReadbackCallback = std::function<void(const ReadbackFrame&)>;
+
+struct Vertex
+{
+    Vec3 position;
+    Vec3 normal;
+    Vec2 uv;
+};
+
+struct MeshLod
+{
+    std::span<const Vertex> vertices;
+    // Triangle list.
+    std::span<const u32> indices;
+};
+
+enum class MeshHandle : u32
+{
+};
+
+enum class TextureHandle : u32
+{
+};
+
+struct Camera
+{
+    Mat4 view;
+    Mat4 projection;
+};
+
+struct PointLight
+{
+    Vec3 position;
+    // Distance at which the light's contribution fades to zero.
+    f32 radius;
+    Vec3 color;
+    f32 intensity;
+};
+
+// Lights are binned into a grid of view space froxels: screen tiles in x and y, exponentially spaced depth slices
+// between the camera's near and far planes in z.
+struct ClusterGrid
+{
+    u32 x;
+    u32 y;
+    u32 z;
+};
+
+constexpr u32 cluster_histogram_bins = 9;
+
+struct ClusterStats
+{
+    ClusterGrid grid;
+    u32 light_count;
+    u32 occupied_clusters;
+    u32 max_cluster_lights;
+    f32 average_lights_per_occupied_cluster;
+    // Summed over all clusters, including the lights that didn't fit into the light index list.
+    u32 light_references;
+    // Clusters that lost some of their lights, because they hit VulkanRenderer::max_lights_per_cluster or the light
+    // index list was full.
+    u32 overflowed_clusters;
+    // Bin 0 counts empty clusters, bin i > 0 clusters with [2^(i - 1), 2^i) lights.
+    std::array<u32, cluster_histogram_bins> histogram;
+};
+
+struct MemoryHeapStats
+{
+    vk::DeviceSize size;
+    // How much of the heap the process can use without degrading performance, and how much it currently uses.
+    vk::DeviceSize budget;
+    vk::DeviceSize usage;
+    bool device_local;
+};
+
+struct MemoryStats
+{
+    // Without VK_EXT_memory_budget, budgets are estimated from the heap sizes and usage only accounts for the memory
+    // allocated by the renderer.
+    bool budget_extension_enabled;
+    std::vector<MemoryHeapStats> heaps;
+    vk::DeviceSize streamed_bytes;
+    // Blocks of device memory that buffers and images are suballocated from. Their number is limited by
+    // maxMemoryAllocationCount.
+    usize memory_blocks;
+    usize resident_mesh_lods;
+    usize resident_textures;
+    // Totals since the renderer was created.
+    u64 uploads;
+    u64 evictions;
+};
+
 class VulkanRenderer
 {
 public:
-    constexpr static std::array required_device_extensions{ vk::KHRSwapchainExtensionName, vk::KHRSpirv14ExtensionName,
+    constexpr static std::array required_device_extensions{ vk::KHRSpirv14ExtensionName,
                                                             vk::KHRSynchronization2ExtensionName,
                                                             vk::KHRCreateRenderpass2ExtensionName };
 
+    // Only required (and enabled) when rendering to a window. VK_KHR_swapchain depends on the VK_KHR_surface instance
+    // extension, which headless renderers don't enable.
+    constexpr static std::array presentation_device_extensions{ vk::KHRSwapchainExtensionName };
+
+    // Enabled when supported by the picked device.
+    constexpr static std::array optional_device_extensions{ vk::EXTMemoryBudgetExtensionName };
+
+    // Enabled when rendering to a window and the picked device supports both extensions and their features.
+    constexpr static std::array present_wait_device_extensions{ vk::KHRPresentIdExtensionName,
+                                                                vk::KHRPresentWaitExtensionName };
+
+    constexpr static u32 max_frames_in_flight = 2;
+
+    constexpr static auto offscreen_target_format = vk::Format::eR8G8B8A8Srgb;
+    constexpr static auto depth_format = vk::Format::eD32Sfloat;
+    constexpr static auto texture_format = vk::Format::eR8G8B8A8Srgb;
+
+    constexpr static u32 max_textures = 4096;
+
+    constexpr static ClusterGrid cluster_grid{ .x = 16, .y = 9, .z = 24 };
+    constexpr static u32 cluster_count = cluster_grid.x * cluster_grid.y * cluster_grid.z;
+    constexpr static u32 max_lights = 8192;
+    // Has to match clustered_lighting.glsl.
+    constexpr static u32 max_lights_per_cluster = 128;
+    // All clusters share a single light index list, sized for this many lights per cluster on average.
+    constexpr static u32 average_lights_per_cluster = 32;
+
+    constexpr static auto default_deletion_time_budget = std::chrono::microseconds{ 500 };
+
+    constexpr static f32 default_eviction_high_watermark = 0.9f;
+    constexpr static f32 default_eviction_low_watermark = 0.8f;
+
 public:
-    [[nodiscard]] static auto create_glfw(const char* application_name, GLFWwindow* window)
+    [[nodiscard]] static auto create_glfw(const char* application_name, GLFWwindow* window,
+                                          PresentMode present_mode = PresentMode::Fifo)
+        -> std::expected<VulkanRenderer, std::string>;
+    // Renders into an offscreen image instead of a window. Doesn't require GLFW to be initialized.
+    [[nodiscard]] static auto create_headless(const char* application_name, u32 width, u32 height)
         -> std::expected<VulkanRenderer, std::string>;
 
+    ~VulkanRenderer();
+
+    VulkanRenderer(const VulkanRenderer&) = delete;
+    auto operator=(const VulkanRenderer&) = delete;
+    VulkanRenderer(VulkanRenderer&&) = default;
+    auto operator=(VulkanRenderer&&) -> VulkanRenderer& = default;
+
+    // Should be called whenever the framebuffer of the window changes size (e.g. from a GLFW framebuffer size
+    // callback). The swapchain is recreated lazily at the start of the next frame.
+    auto notify_framebuffer_resized() -> void;
+
+    // Falls back to PresentMode::Fifo if the requested mode isn't supported. The swapchain is recreated with the new
+    // mode at the start of the next frame.
+    auto set_present_mode(PresentMode present_mode) -> void;
+    [[nodiscard]] auto present_mode() const -> PresentMode;
+    [[nodiscard]] auto is_present_mode_supported(PresentMode present_mode) const -> bool;
+
+    // Whether wait_for_present() is available, which needs VK_KHR_present_id and VK_KHR_present_wait.
+    [[nodiscard]] auto supports_present_wait() const -> bool;
+    // Id of the last frame handed to the presentation engine, or 0 if there was none. Ids increase by one with every
+    // presented frame, so render_frame() presented a frame if it changed.
+    [[nodiscard]] auto last_present_id() const -> u64;
+    // Waits until the frame with the given id is on screen, or the timeout expires. A zero timeout polls.
+    [[nodiscard]] auto wait_for_present(u64 present_id, std::chrono::nanoseconds timeout) const
+        -> std::expected<PresentStatus, std::string>;
+
+    [[nodiscard]] auto render_frame() -> std::expected<void, std::string>;
+    // Waits for the GPU to finish every frame submitted so far, e.g. to time a workload. Unlike destroying the
+    // renderer, this doesn't wait for the device to go idle.
+    [[nodiscard]] auto wait_for_gpu() const -> std::expected<void, std::string>;
+
+    // Copies every rendered frame into a ring of host-visible buffers. A frame is handed to the callback from
+    // render_frame() once the GPU has finished with it, so the CPU never waits for the copy unless the ring is smaller
+    // than the number of frames in flight. The callback should copy the pixels out and return quickly.
+    [[nodiscard]] auto enable_frame_readback(u32 ring_size, ReadbackCallback callback)
+        -> std::expected<void, std::string>;
+    // Waits for the outstanding readbacks and delivers them before disabling readback.
+    [[nodiscard]] auto disable_frame_readback() -> std::expected<void, std::string>;
+
+    // Destroys the object once every frame submitted so far has completed on the GPU, instead of waiting for the
+    // device to go idle. Retired objects are destroyed at the start of render_frame(), within the deletion time budget.
+    template<typename T>
+        requires(!std::is_lvalue_reference_v<T>)
+    auto destroy_deferred(T&& object) -> void
+    {
+        _deletion_queue.push(std::move(object), _frame_timeline_value);
+    }
+
+    // Limits how much time render_frame() spends destroying retired objects, so that releasing many resources at once
+    // gets spread over several frames.
+    auto set_deletion_time_budget(std::chrono::nanoseconds time_budget) -> void;
+    [[nodiscard]] auto pending_deletion_count() const -> usize;
+
+    // Meshes and textures keep a CPU copy of their data. The GPU copy is created when they're first drawn and may be
+    // evicted when memory runs low, in which case it's uploaded again the next time they're drawn.
+    [[nodiscard]] auto create_mesh(std::span<const MeshLod> lods) -> std::expected<MeshHandle, std::string>;
+    auto destroy_mesh(MeshHandle mesh) -> void;
+    // Pixels are tightly packed sRGB RGBA8. Neither dimension may exceed the device's maxImageDimension2D.
+    [[nodiscard]] auto create_texture(u32 width, u32 height, std::span<const std::byte> pixels)
+        -> std::expected<TextureHandle, std::string>;
+    auto destroy_texture(TextureHandle texture) -> void;
+
+    auto set_camera(const Camera& camera) -> void;
+    // Draws are collected until the next render_frame(). If the requested LOD can't be made resident, the closest
+    // resident LOD is drawn instead. Draws without a texture use plain white.
+    auto submit_draw(MeshHandle mesh, u32 lod, const Mat4& transform,
+                     std::optional<TextureHandle> texture = std::nullopt) -> void;
+
+    // Lights are collected until the next render_frame(), like draws. Lights beyond max_lights are ignored.
+    auto submit_light(const PointLight& light) -> void;
+    // Statistics of the most recent frame whose light binning has completed on the GPU.
+    [[nodiscard]] auto cluster_stats() const -> ClusterStats;
+
+    // Streamed resources that weren't used in the current frame are evicted, least recently used first, once a heap
+    // goes over high_watermark of its budget, until usage is back under low_watermark of the budget.
+    auto set_eviction_watermarks(f32 high_watermark, f32 low_watermark) -> void;
+    // Budgets and usage are polled at the start of every frame.
+    [[nodiscard]] auto memory_stats() const -> MemoryStats;
+
+    // Records the calls to the resource, draw, light and camera functions above and to render_frame() into a command
+    // stream file, until the capture is stopped. Resources that already exist aren't recorded, so a capture should
+    // start before the workload creates its resources. The stream stores the current render target size.
+    [[nodiscard]] auto start_command_capture(const std::filesystem::path& path) -> std::expected<void, std::string>;
+    // Returns the number of captured frames.
+    [[nodiscard]] auto stop_command_capture() -> std::expected<u64, std::string>;
+    [[nodiscard]] auto is_capturing_commands() const -> bool;
+
+private:
+    enum class MemoryUsage : u8
+    {
+        GpuOnly,
+        Upload,
+        Readback,
+        // Device-local memory that's also host-visible, i.e. resizable BAR on discrete GPUs or any memory on UMA ones.
+        Dynamic,
+    };
+
+    struct Buffer
+    {
+        MemoryAllocation allocation{};
+        vk::raii::Buffer buffer{ nullptr };
+        vk::DeviceSize size{ 0 };
+        // Host-visible buffers stay mapped for their whole lifetime.
+        std::byte* mapped{ nullptr };
+    };
+
+    // Written by the CPU every frame and read by shaders. Shaders read it from host-visible device-local memory when
+    // there's some, otherwise the CPU writes to a staging buffer that's copied to a GPU-only buffer each frame.
+    struct DynamicBuffer
+    {
+        Buffer buffer{};
+        // Only created when the buffer itself isn't host-visible.
+        Buffer staging_buffer{};
+        // Where the CPU writes, in either buffer.
+        std::byte* mapped{ nullptr };
+    };
+
+    struct Image
+    {
+        MemoryAllocation allocation{};
+        vk::raii::Image image{ nullptr };
+        vk::raii::ImageView image_view{ nullptr };
+        vk::Extent2D extent{};
+        vk::Format format{ vk::Format::eUndefined };
+    };
+
+    struct RenderTarget
+    {
+        vk::Image image;
+        vk::ImageView image_view;
+        vk::Image depth_image;
+        vk::ImageView depth_image_view;
+        vk::Extent2D extent;
+        // Left in whatever layout rendering ended in if not set.
+        std::optional<vk::ImageLayout> final_layout;
+    };
+
+    struct ReadbackSlot
+    {
+        Buffer buffer{};
+        vk::Extent2D extent{};
+        PixelFormat format{ PixelFormat::Rgba8 };
+        u64 frame_number{ 0 };
+        u64 timeline_value{ 0 };
+        // Set while the slot holds a frame that hasn't been handed to the callback yet.
+        bool pending{ false };
+    };
+
+    struct Frame
+    {
+        vk::raii::CommandBuffer command_buffer{ nullptr };
+        vk::raii::Semaphore image_available_semaphore{ nullptr };
+        // Value of the frame timeline semaphore signaled by the last submission recorded with this frame.
+        u64 timeline_value{ 0 };
+        DynamicBuffer uniform_buffer{};
+        DynamicBuffer light_buffer{};
+        Buffer light_grid_buffer{};
+        Buffer light_index_buffer{};
+        // Written with atomics by the light binning, so it's kept in device-local memory and copied to the readback
+        // buffer afterwards.
+        Buffer cluster_stats_buffer{};
+        Buffer cluster_stats_readback_buffer{};
+        u32 light_count{ 0 };
+        vk::raii::DescriptorSet descriptor_set{ nullptr };
+    };
+
+    // Everything that depends on the size of the window and has to be rebuilt when the swapchain is recreated.
+    struct Swapchain
+    {
+        vk::raii::SwapchainKHR swapchain{ nullptr };
+        vk::Extent2D extent{};
+        vk::ImageUsageFlags usage{};
+        std::vector<vk::Image> images{};
+        std::vector<vk::raii::ImageView> image_views{};
+        // Indexed by swapchain image, since presentation may still be waiting on a semaphore after the frame that
+        // signaled it has been retired.
+        std::vector<vk::raii::Semaphore> render_finished_semaphores{};
+        Image depth_image{};
+        // Frames presented before can't be waited for anymore, since that takes the swapchain they were presented to.
+        u64 first_present_id{ 0 };
+    };
+
+    struct GpuMeshLod
+    {
+        Buffer vertex_buffer{};
+        Buffer index_buffer{};
+    };
+
+    struct GpuTexture
+    {
+        Image image{};
+        vk::raii::DescriptorSet descriptor_set{ nullptr };
+    };
+
+    // Memory held by the GPU copy of a streamed resource, and when it was last drawn.
+    struct Residency
+    {
+        u64 last_used_frame{ 0 };
+        u32 heap_index{ 0 };
+        vk::DeviceSize size{ 0 };
+    };
+
+    struct MeshLodResource
+    {
+        std::vector<Vertex> vertices{};
+        std::vector<u32> indices{};
+        std::optional<GpuMeshLod> gpu{};
+        Residency residency{};
+    };
+
+    struct MeshResource
+    {
+        std::vector<MeshLodResource> lods{};
+    };
+
+    struct TextureResource
+    {
+        vk::Extent2D extent{};
+        std::vector<std::byte> pixels{};
+        std::optional<GpuTexture> gpu{};
+        Residency residency{};
+    };
+
+    struct EvictionCandidate
+    {
+        u64 last_used_frame;
+        vk::DeviceSize size;
+        MeshLodResource* mesh_lod;
+        TextureResource* texture;
+    };
+
+    struct Draw
+    {
+        MeshHandle mesh;
+        u32 lod;
+        Mat4 transform;
+        std::optional<TextureHandle> texture;
+    };
+
+    // A draw whose resources are resident, ready to be recorded.
+    struct ResolvedDraw
+    {
+        vk::Buffer vertex_buffer;
+        vk::Buffer index_buffer;
+        u32 index_count;
+        vk::DescriptorSet texture_descriptor_set;
+        Mat4 transform;
+    };
+
+    struct BufferUpload
+    {
+        Buffer staging_buffer;
+        vk::Buffer destination;
+    };
+
+    struct ImageUpload
+    {
+        Buffer staging_buffer;
+        vk::Image destination;
+        vk::Extent2D extent;
+    };
+
 private:
     vk::raii::Context _context{};
     vk::raii::Instance _instance{ nullptr };
@@ -34,14 +476,100 @@ private:
     vk::raii::Device _device{ nullptr };
     vk::raii::Queue _graphics_queue{ nullptr };
     vk::raii::DebugUtilsMessengerEXT _debug_messenger{ nullptr };
+    // Heap-allocated, because allocations point back at it and the renderer can be moved. Declared before everything
+    // that holds allocations, so that it's destroyed after them.
+    std::unique_ptr<MemoryAllocator> _memory_allocator{};
+
+    GLFWwindow* _window{ nullptr };
+    u32 _graphics_queue_family_index{ 0 };
+    vk::SurfaceFormatKHR _surface_format{};
+    std::vector<vk::PresentModeKHR> _supported_present_modes{};
+    PresentMode _present_mode{ PresentMode::Fifo };
+
+    vk::raii::CommandPool _command_pool{ nullptr };
+    vk::raii::DescriptorPool _descriptor_pool{ nullptr };
+    vk::raii::Semaphore _frame_timeline{ nullptr };
+    u64 _frame_timeline_value{ 0 };
+    std::array<Frame, max_frames_in_flight> _frames{};
+    u32 _frame_index{ 0 };
+
+    Swapchain _swapchain{};
+    bool _swapchain_out_of_date{ false };
+    bool _present_wait_enabled{ false };
+    u64 _present_id{ 0 };
+
+    DeletionQueue _deletion_queue{};
+    std::chrono::nanoseconds _deletion_time_budget{ default_deletion_time_budget };
+
+    // Only used by headless renderers.
+    Image _offscreen_target{};
+    Image _offscreen_depth{};
+
+    std::vector<ReadbackSlot> _readback_slots{};
+    u32 _readback_slot_index{ 0 };
+    ReadbackCallback _readback_callback{};
+    u64 _frame_number{ 0 };
+
+    vk::raii::DescriptorSetLayout _frame_descriptor_set_layout{ nullptr };
+    vk::raii::DescriptorSetLayout _texture_descriptor_set_layout{ nullptr };
+    vk::raii::PipelineLayout _forward_pipeline_layout{ nullptr };
+    vk::raii::Pipeline _forward_pipeline{ nullptr };
+    vk::raii::Sampler _texture_sampler{ nullptr };
+    GpuTexture _default_texture{};
+    Camera _camera{ .view = math::identity(), .projection = math::identity() };
+
+    vk::raii::PipelineLayout _light_binning_pipeline_layout{ nullptr };
+    vk::raii::Pipeline _light_binning_pipeline{ nullptr };
+    std::vector<PointLight> _lights{};
+    ClusterStats _cluster_stats{ .grid = cluster_grid };
+
+    std::vector<std::optional<MeshResource>> _meshes{};
+    std::vector<u32> _free_mesh_slots{};
+    std::vector<std::optional<TextureResource>> _textures{};
+    std::vector<u32> _free_texture_slots{};
+    std::vector<Draw> _draws{};
+    std::vector<ResolvedDraw> _resolved_draws{};
+    // Recorded at the start of the next frame's command buffer.
+    std::vector<BufferUpload> _buffer_uploads{};
+    std::vector<ImageUpload> _image_uploads{};
+
+    bool _memory_budget_enabled{ false };
+    // Memory type that GPU-only memory is allocated from, and its heap, which is checked against its budget before
+    // streaming resources in.
+    u32 _streaming_memory_type_index{ 0 };
+    u32 _streaming_heap_index{ 0 };
+    // The following are indexed by memory heap.
+    std::vector<MemoryHeapStats> _memory_heaps{};
+    // Memory reserved by the allocator when the heap usage was polled, see heap_usage_estimate().
+    std::vector<vk::DeviceSize> _polled_reserved_bytes{};
+    std::vector<vk::DeviceSize> _streamed_bytes{};
+    f32 _eviction_high_watermark{ default_eviction_high_watermark };
+    f32 _eviction_low_watermark{ default_eviction_low_watermark };
+    u64 _upload_count{ 0 };
+    u64 _eviction_count{ 0 };
+
+    // Streamed resources of one heap that weren't used in the current frame, least recently used first. Collected by
+    // the first eviction of a frame and consumed by the following ones, so that streaming in many resources doesn't
+    // rescan and re-sort all of them every time. Points into _meshes and _textures, so it's only valid within
+    // prepare_frame().
+    std::vector<EvictionCandidate> _eviction_candidates{};
+    usize _next_eviction_candidate{ 0 };
+    std::optional<u32> _eviction_candidates_heap_index{};
+
+    std::optional<CommandStreamWriter> _command_capture{};
 
 private:
     explicit VulkanRenderer(vk::raii::Context&& context, vk::raii::Instance&& instance, vk::raii::SurfaceKHR&& surface,
                             vk::raii::PhysicalDevice&& physical_device, vk::raii::Device&& device,
-                            vk::raii::Queue&& graphics_queue, vk::raii::DebugUtilsMessengerEXT&& debug_messenger);
+                            vk::raii::Queue&& graphics_queue, vk::raii::DebugUtilsMessengerEXT&& debug_messenger,
+                            GLFWwindow* window, u32 graphics_queue_family_index);
+
+    // Creates everything shared by windowed and headless renderers. The window is null for headless renderers.
+    [[nodiscard]] static auto create(const char* application_name, GLFWwindow* window)
+        -> std::expected<VulkanRenderer, std::string>;
 
     [[nodiscard]] static auto get_vulkan_layers() -> std::vector<const char*>;
-    [[nodiscard]] static auto get_vulkan_extensions() -> std::vector<const char*>;
+    [[nodiscard]] static auto get_vulkan_extensions(bool surface_support) -> std::vector<const char*>;
 
     [[nodiscard]] static auto validate_layers(const vk::raii::Context& context, std::span<const char* const> layers)
         -> std::expected<void, std::string>;
@@ -55,14 +583,113 @@ private:
     [[nodiscard]] static auto create_surface(const vk::raii::Instance& instance, GLFWwindow* window)
         -> std::expected<vk::raii::SurfaceKHR, std::string>;
 
-    [[nodiscard]] static auto pick_physical_device(const vk::raii::Instance& instance)
+    [[nodiscard]] static auto pick_physical_device(const vk::raii::Instance& instance, bool presentation)
         -> std::expected<vk::raii::PhysicalDevice, std::string>;
-    [[nodiscard]] static auto is_suitable(const vk::PhysicalDevice& physical_device)
+    [[nodiscard]] static auto is_suitable(const vk::PhysicalDevice& physical_device, bool presentation)
         -> std::expected<bool, std::string>;
 
-    [[nodiscard]] static auto create_device(const vk::raii::PhysicalDevice& physical_device)
+    // Required extensions (including the presentation ones when rendering to a window), followed by the optional ones
+    // supported by the device.
+    [[nodiscard]] static auto get_device_extensions(const vk::raii::PhysicalDevice& physical_device,
+                                                    bool presentation)
+        -> std::expected<std::vector<const char*>, std::string>;
+    [[nodiscard]] static auto create_device(const vk::raii::PhysicalDevice& physical_device,
+                                            std::span<const char* const> extensions)
         -> std::expected<std::tuple<vk::raii::Device, vk::raii::Queue>, std::string>;
     [[nodiscard]] static auto find_graphics_queue_family(const vk::raii::PhysicalDevice& physical_device) -> u32;
+
+    [[nodiscard]] static auto choose_surface_format(const vk::raii::PhysicalDevice& physical_device,
+                                                    const vk::raii::SurfaceKHR& surface)
+        -> std::expected<vk::SurfaceFormatKHR, std::string>;
+
+    [[nodiscard]] auto create_frames() -> std::expected<void, std::string>;
+    // Has to be called once the render target format is known.
+    [[nodiscard]] auto create_forward_pass() -> std::expected<void, std::string>;
+    [[nodiscard]] auto create_frame_resources() -> std::expected<void, std::string>;
+    [[nodiscard]] auto create_light_binning_pipeline() -> std::expected<void, std::string>;
+    [[nodiscard]] auto create_forward_pipeline() -> std::expected<void, std::string>;
+    [[nodiscard]] auto create_shader_module(std::span<const u32> spirv) const
+        -> std::expected<vk::raii::ShaderModule, std::string>;
+    [[nodiscard]] auto allocate_descriptor_set(vk::DescriptorSetLayout layout)
+        -> std::expected<vk::raii::DescriptorSet, std::string>;
+
+    // Returns nullopt if the surface currently has an empty extent.
+    [[nodiscard]] auto create_swapchain(vk::SwapchainKHR old_swapchain)
+        -> std::expected<std::optional<Swapchain>, std::string>;
+    // Returns false if the window currently has no area to render to (e.g. it's minimized).
+    [[nodiscard]] auto recreate_swapchain() -> std::expected<bool, std::string>;
+    [[nodiscard]] auto completed_timeline_value() const -> std::expected<u64, std::string>;
+    [[nodiscard]] auto wait_for_timeline_value(u64 timeline_value) const -> std::expected<void, std::string>;
+
+    [[nodiscard]] auto render_window_frame() -> std::expected<void, std::string>;
+    [[nodiscard]] auto render_headless_frame() -> std::expected<void, std::string>;
+    // Updates the frame's uniforms and lights, and makes the resources of the submitted draws resident.
+    [[nodiscard]] auto prepare_frame(Frame& frame, vk::Extent2D extent) -> std::expected<void, std::string>;
+    [[nodiscard]] auto read_cluster_stats(const Frame& frame) -> std::expected<void, std::string>;
+    [[nodiscard]] auto record_frame(const Frame& frame, const RenderTarget& render_target,
+                                    const ReadbackSlot* readback_slot) -> std::expected<void, std::string>;
+    auto record_uploads(const vk::raii::CommandBuffer& command_buffer) const -> void;
+    auto record_dynamic_buffer_copies(const Frame& frame) const -> void;
+    auto record_light_binning(const Frame& frame) const -> void;
+    auto record_draws(const Frame& frame, vk::Extent2D extent) const -> void;
+    // Null semaphores are skipped.
+    [[nodiscard]] auto submit_frame(Frame& frame, vk::Semaphore wait_semaphore, vk::Semaphore signal_semaphore,
+                                    ReadbackSlot* readback_slot) -> std::expected<void, std::string>;
+
+    [[nodiscard]] auto render_target_format() const -> vk::Format;
+    [[nodiscard]] auto readback_pixel_format() const -> std::optional<PixelFormat>;
+    // Returns null if frame readback is disabled.
+    [[nodiscard]] auto acquire_readback_slot(vk::Extent2D extent) -> std::expected<ReadbackSlot*, std::string>;
+    [[nodiscard]] auto deliver_completed_readbacks(u64 completed_timeline_value) -> std::expected<void, std::string>;
+    [[nodiscard]] auto deliver_readback(ReadbackSlot& slot) -> std::expected<void, std::string>;
+
+    [[nodiscard]] auto find_mesh(MeshHandle mesh) -> MeshResource*;
+    [[nodiscard]] auto find_texture(TextureHandle texture) -> TextureResource*;
+    // Falls back to the closest resident LOD. Returns null if none is resident.
+    [[nodiscard]] auto resident_mesh_lod(MeshResource& mesh, u32 lod) -> const MeshLodResource*;
+    // Returns false if the resource couldn't be made resident.
+    [[nodiscard]] auto make_resident(MeshLodResource& lod) -> bool;
+    [[nodiscard]] auto make_resident(TextureResource& texture) -> bool;
+    [[nodiscard]] auto create_gpu_mesh_lod(std::span<const Vertex> vertices, std::span<const u32> indices)
+        -> std::expected<GpuMeshLod, std::string>;
+    [[nodiscard]] auto create_gpu_texture(vk::Extent2D extent, std::span<const std::byte> pixels)
+        -> std::expected<GpuTexture, std::string>;
+    [[nodiscard]] auto create_staging_buffer(std::span<const std::byte> data) -> std::expected<Buffer, std::string>;
+
+    // Evicts ahead of time if the allocation would push the streaming heap over its high watermark. If the allocation
+    // fails anyway, makes room for it to succeed on a later frame.
+    template<typename CreateFunction>
+    [[nodiscard]] auto create_streamed(vk::DeviceSize size, bool optimal_tiling, CreateFunction&& create)
+        -> std::invoke_result_t<CreateFunction>;
+    auto track_streamed_allocation(Residency& residency, u32 heap_index, vk::DeviceSize size) -> void;
+    auto release_streamed_allocation(Residency& residency) -> void;
+    // Hands the GPU copy to the deletion queue. Its memory is counted as retired until the queue destroys it, since the
+    // driver keeps reporting it as used until then.
+    auto destroy_gpu_copy(MeshLodResource& lod) -> void;
+    auto destroy_gpu_copy(TextureResource& texture) -> void;
+    auto evict(MeshLodResource& lod) -> void;
+    auto evict(TextureResource& texture) -> void;
+    auto collect_eviction_candidates(u32 heap_index) -> void;
+    // Returns the number of bytes freed.
+    auto evict_streamed_resources(u32 heap_index, vk::DeviceSize bytes_to_free) -> vk::DeviceSize;
+    auto update_memory_budget() -> void;
+    // What the heap usage will be once retired memory has been destroyed, assuming that destroying it releases its
+    // blocks. If it doesn't, the next poll reports the blocks as used again and more gets evicted.
+    [[nodiscard]] auto heap_usage_estimate(u32 heap_index) const -> vk::DeviceSize;
+    auto enforce_memory_budget() -> void;
+    [[nodiscard]] auto heap_watermark(u32 heap_index, f32 watermark) const -> vk::DeviceSize;
+
+    [[nodiscard]] auto find_memory_type(u32 type_bits, vk::MemoryPropertyFlags required,
+                                        vk::MemoryPropertyFlags preferred) const -> std::optional<u32>;
+    // Images use optimal tiling, buffers are linear.
+    [[nodiscard]] auto allocate_memory(const vk::MemoryRequirements& requirements, MemoryUsage memory_usage,
+                                       bool optimal_tiling) -> std::expected<MemoryAllocation, std::string>;
+    [[nodiscard]] auto create_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryUsage memory_usage)
+        -> std::expected<Buffer, std::string>;
+    [[nodiscard]] auto create_dynamic_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage)
+        -> std::expected<DynamicBuffer, std::string>;
+    [[nodiscard]] auto create_image(vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage,
+                                    vk::ImageAspectFlags aspect) -> std::expected<Image, std::string>;
 };
 
 } // namespace renderer
@@ -0,0 +1,61 @@
+// Resources shared by the light binning compute pass and the forward pass. Sizes and layouts have to match the
+// constants and structs in vulkan_renderer.hpp and vulkan_renderer.cpp.
+
+#ifndef LIGHT_GRID_ACCESS
+#define LIGHT_GRID_ACCESS readonly
+#endif
+
+const uint max_lights_per_cluster = 128;
+
+struct PointLight
+{
+    // World space position and radius of influence.
+    vec4 position_radius;
+    vec4 color_intensity;
+};
+
+layout(set = 0, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    // xyz: cluster grid size, w: light count.
+    uvec4 cluster_grid;
+    // x: near plane, y: far plane, z: log(far / near).
+    vec4 cluster_depth;
+    // xy: cluster tile size in pixels, zw: 1 / render target size.
+    vec4 cluster_tile;
+}
+frame;
+
+layout(set = 0, binding = 1, std430) readonly buffer Lights
+{
+    PointLight lights[];
+};
+
+// Offset into the light index list and number of lights of every cluster.
+layout(set = 0, binding = 2, std430) LIGHT_GRID_ACCESS buffer LightGrid
+{
+    uvec2 light_grid[];
+};
+
+layout(set = 0, binding = 3, std430) LIGHT_GRID_ACCESS buffer LightIndices
+{
+    uint light_indices[];
+};
+
+uint cluster_index(uvec3 cluster)
+{
+    return (cluster.z * frame.cluster_grid.y + cluster.y) * frame.cluster_grid.x + cluster.x;
+}
+
+// Depth slices are spaced exponentially, so that clusters stay roughly cube-shaped.
+float slice_depth(uint slice)
+{
+    return frame.cluster_depth.x * exp(frame.cluster_depth.z * float(slice) / float(frame.cluster_grid.z));
+}
+
+uint depth_slice(float view_depth)
+{
+    const float slice = log(view_depth / frame.cluster_depth.x) / frame.cluster_depth.z * float(frame.cluster_grid.z);
+    return uint(clamp(slice, 0.0, float(frame.cluster_grid.z - 1u)));
+}
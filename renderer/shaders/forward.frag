@@ -0,0 +1,44 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "clustered_lighting.glsl"
+
+layout(set = 1, binding = 0) uniform sampler2D albedo_texture;
+
+layout(location = 0) in vec3 in_world_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_uv;
+layout(location = 3) in float in_view_depth;
+
+layout(location = 0) out vec4 out_color;
+
+void main()
+{
+    const vec3 albedo = texture(albedo_texture, in_uv).rgb;
+    const vec3 normal = normalize(in_normal);
+
+    // Hemisphere ambient lighting.
+    const float sky_factor = 0.5 + 0.5 * normal.y;
+    vec3 lighting = mix(vec3(0.05), vec3(0.25), sky_factor);
+
+    const uvec2 tile = min(uvec2(gl_FragCoord.xy / frame.cluster_tile.xy), frame.cluster_grid.xy - 1u);
+    const uvec2 cluster_lights = light_grid[cluster_index(uvec3(tile, depth_slice(in_view_depth)))];
+
+    for (uint i = 0; i < cluster_lights.y; i++)
+    {
+        const PointLight light = lights[light_indices[cluster_lights.x + i]];
+
+        const vec3 to_light = light.position_radius.xyz - in_world_position;
+        const float distance = max(length(to_light), 1e-4);
+        const float radius = light.position_radius.w;
+
+        // Inverse square falloff, windowed to reach zero at the light's radius.
+        const float window = clamp(1.0 - pow(distance / radius, 4.0), 0.0, 1.0);
+        const float attenuation = window * window / (distance * distance + 1.0);
+        const float diffuse = max(dot(normal, to_light / distance), 0.0);
+
+        lighting += light.color_intensity.rgb * light.color_intensity.w * attenuation * diffuse;
+    }
+
+    out_color = vec4(albedo * lighting, 1.0);
+}
@@ -0,0 +1,32 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "clustered_lighting.glsl"
+
+layout(push_constant) uniform DrawConstants
+{
+    mat4 model;
+}
+draw;
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_uv;
+
+layout(location = 0) out vec3 out_world_position;
+layout(location = 1) out vec3 out_normal;
+layout(location = 2) out vec2 out_uv;
+layout(location = 3) out float out_view_depth;
+
+void main()
+{
+    const vec4 world_position = draw.model * vec4(in_position, 1.0);
+    const vec4 view_position = frame.view * world_position;
+
+    out_world_position = world_position.xyz;
+    out_normal = mat3(draw.model) * in_normal;
+    out_uv = in_uv;
+    out_view_depth = -view_position.z;
+
+    gl_Position = frame.projection * view_position;
+}
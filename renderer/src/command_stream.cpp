@@ -0,0 +1,607 @@
+#include "renderer/command_stream.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <ios>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include "renderer/vulkan_renderer.hpp"
+
+namespace renderer {
+
+namespace {
+
+static_assert(std::endian::native == std::endian::little, "Command streams store raw little-endian data.");
+static_assert(sizeof(Vertex) == sizeof(f32) * 8, "Vertices are stored without padding.");
+
+using Magic = std::array<char, 8>;
+
+constexpr auto magic = Magic{ 'R', 'N', 'D', 'C', 'M', 'D', 'S', '\0' };
+// Bumped whenever the layout of a record changes. Older streams are rejected rather than misread.
+constexpr u32 version = 1;
+
+enum class Opcode : u8
+{
+    CreateMesh = 1,
+    DestroyMesh,
+    CreateTexture,
+    DestroyTexture,
+    SetCamera,
+    SubmitDraw,
+    SubmitLight,
+    SetEvictionWatermarks,
+    RenderFrame,
+};
+
+using Clock = std::chrono::steady_clock;
+
+auto append_bytes(std::vector<std::byte>& buffer, std::span<const std::byte> bytes) -> void
+{
+    buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+}
+
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+auto append(std::vector<std::byte>& buffer, const T& value) -> void
+{
+    append_bytes(buffer, std::as_bytes(std::span{ &value, 1 }));
+}
+
+auto append_varint(std::vector<std::byte>& buffer, u64 value) -> void
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<std::byte>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+
+    buffer.push_back(static_cast<std::byte>(value));
+}
+
+auto append_opcode(std::vector<std::byte>& buffer, Opcode opcode) -> void
+{
+    buffer.push_back(static_cast<std::byte>(opcode));
+}
+
+// Reads past the end or malformed values put the reader into a failed state, in which every read returns a default
+// value. Callers check failed() once per record instead of after every field.
+class ByteReader
+{
+public:
+    explicit ByteReader(std::span<const std::byte> data) : _data{ data } {}
+
+    [[nodiscard]] auto at_end() const -> bool { return _offset == _data.size(); }
+    [[nodiscard]] auto failed() const -> bool { return _failed; }
+    [[nodiscard]] auto offset() const -> usize { return _offset; }
+    [[nodiscard]] auto remaining() const -> usize { return _data.size() - _offset; }
+
+    auto fail() -> void { _failed = true; }
+
+    auto read_bytes(usize size) -> std::span<const std::byte>
+    {
+        if (_failed || size > _data.size() - _offset)
+        {
+            _failed = true;
+            return {};
+        }
+
+        auto bytes = _data.subspan(_offset, size);
+        _offset += size;
+
+        return bytes;
+    }
+
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    auto read() -> T
+    {
+        auto value = T{};
+        auto bytes = read_bytes(sizeof(T));
+
+        if (!bytes.empty())
+            std::memcpy(&value, bytes.data(), sizeof(T));
+
+        return value;
+    }
+
+    auto read_varint() -> u64
+    {
+        auto value = u64{ 0 };
+
+        for (u32 shift = 0; shift < 64; shift += 7)
+        {
+            const auto byte = std::to_integer<u64>(read<std::byte>());
+
+            if (_failed)
+                return 0;
+
+            value |= (byte & 0x7f) << shift;
+
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+
+        _failed = true;
+
+        return 0;
+    }
+
+    auto read_u32() -> u32
+    {
+        const auto value = read_varint();
+
+        if (value > std::numeric_limits<u32>::max())
+        {
+            _failed = true;
+            return 0;
+        }
+
+        return static_cast<u32>(value);
+    }
+
+private:
+    std::span<const std::byte> _data;
+    usize _offset{ 0 };
+    bool _failed{ false };
+};
+
+auto read_vec3(ByteReader& reader) -> Vec3
+{
+    return Vec3{ reader.read<f32>(), reader.read<f32>(), reader.read<f32>() };
+}
+
+auto read_point_light(ByteReader& reader) -> PointLight
+{
+    auto light = PointLight{};
+    light.position = read_vec3(reader);
+    light.radius = reader.read<f32>();
+    light.color = read_vec3(reader);
+    light.intensity = reader.read<f32>();
+
+    return light;
+}
+
+// Copies an array of T out of the stream, which gives no alignment guarantees.
+template<typename T> auto read_array(ByteReader& reader, usize count, std::vector<T>& values) -> void
+{
+    if (count > reader.remaining() / sizeof(T))
+    {
+        reader.fail();
+        return;
+    }
+
+    auto bytes = reader.read_bytes(count * sizeof(T));
+
+    values.resize(bytes.size() / sizeof(T));
+
+    if (!bytes.empty())
+        std::memcpy(values.data(), bytes.data(), bytes.size());
+}
+
+} // namespace
+
+auto CommandStreamWriter::create(const std::filesystem::path& path, u32 width, u32 height)
+    -> std::expected<CommandStreamWriter, std::string>
+{
+    auto file = std::ofstream{ path, std::ios::binary | std::ios::trunc };
+
+    if (!file)
+        return std::unexpected{ std::format("Failed to open {} for writing.", path.string()) };
+
+    auto writer = CommandStreamWriter{ path, std::move(file) };
+
+    append(writer._buffer, magic);
+    append(writer._buffer, version);
+    append(writer._buffer, width);
+    append(writer._buffer, height);
+
+    return writer;
+}
+
+CommandStreamWriter::CommandStreamWriter(std::filesystem::path path, std::ofstream file)
+    : _path{ std::move(path) }, _file{ std::move(file) }
+{}
+
+auto CommandStreamWriter::create_mesh(std::span<const MeshLod> lods, MeshHandle mesh) -> void
+{
+    append_opcode(_buffer, Opcode::CreateMesh);
+    append_varint(_buffer, std::to_underlying(mesh));
+    append_varint(_buffer, lods.size());
+
+    for (const auto& lod : lods)
+    {
+        append_varint(_buffer, lod.vertices.size());
+        append_varint(_buffer, lod.indices.size());
+        append_bytes(_buffer, std::as_bytes(lod.vertices));
+        append_bytes(_buffer, std::as_bytes(lod.indices));
+    }
+
+    flush_if_full();
+}
+
+auto CommandStreamWriter::destroy_mesh(MeshHandle mesh) -> void
+{
+    append_opcode(_buffer, Opcode::DestroyMesh);
+    append_varint(_buffer, std::to_underlying(mesh));
+}
+
+auto CommandStreamWriter::create_texture(u32 width, u32 height, std::span<const std::byte> pixels,
+                                         TextureHandle texture) -> void
+{
+    append_opcode(_buffer, Opcode::CreateTexture);
+    append_varint(_buffer, std::to_underlying(texture));
+    append_varint(_buffer, width);
+    append_varint(_buffer, height);
+    append_bytes(_buffer, pixels);
+
+    flush_if_full();
+}
+
+auto CommandStreamWriter::destroy_texture(TextureHandle texture) -> void
+{
+    append_opcode(_buffer, Opcode::DestroyTexture);
+    append_varint(_buffer, std::to_underlying(texture));
+}
+
+auto CommandStreamWriter::set_camera(const Camera& camera) -> void
+{
+    append_opcode(_buffer, Opcode::SetCamera);
+    append(_buffer, camera.view);
+    append(_buffer, camera.projection);
+}
+
+auto CommandStreamWriter::submit_draw(MeshHandle mesh, u32 lod, const Mat4& transform,
+                                      std::optional<TextureHandle> texture) -> void
+{
+    append_opcode(_buffer, Opcode::SubmitDraw);
+    append_varint(_buffer, std::to_underlying(mesh));
+    append_varint(_buffer, lod);
+    // 0 means untextured, so that the common case of a small handle still fits into a single byte.
+    append_varint(_buffer, texture ? u64{ std::to_underlying(*texture) } + 1 : 0);
+    append(_buffer, transform);
+}
+
+auto CommandStreamWriter::submit_light(const PointLight& light) -> void
+{
+    append_opcode(_buffer, Opcode::SubmitLight);
+    append(_buffer, light.position);
+    append(_buffer, light.radius);
+    append(_buffer, light.color);
+    append(_buffer, light.intensity);
+}
+
+auto CommandStreamWriter::set_eviction_watermarks(f32 high_watermark, f32 low_watermark) -> void
+{
+    append_opcode(_buffer, Opcode::SetEvictionWatermarks);
+    append(_buffer, high_watermark);
+    append(_buffer, low_watermark);
+}
+
+auto CommandStreamWriter::render_frame() -> void
+{
+    append_opcode(_buffer, Opcode::RenderFrame);
+    _frame_count++;
+
+    flush_if_full();
+}
+
+auto CommandStreamWriter::finish() -> std::expected<void, std::string>
+{
+    flush();
+    _file.flush();
+
+    if (!_file)
+        return std::unexpected{ std::format("Failed to write {}.", _path.string()) };
+
+    return {};
+}
+
+auto CommandStreamWriter::flush_if_full() -> void
+{
+    if (_buffer.size() >= flush_threshold)
+        flush();
+}
+
+auto CommandStreamWriter::flush() -> void
+{
+    if (_buffer.empty())
+        return;
+
+    // Once the stream has failed, further writes are no-ops and finish() reports the error.
+    _file.write(reinterpret_cast<const char*>(_buffer.data()), static_cast<std::streamsize>(_buffer.size()));
+    _written_size += _buffer.size();
+    _buffer.clear();
+}
+
+auto CommandStream::load(const std::filesystem::path& path) -> std::expected<CommandStream, std::string>
+{
+    auto file = std::ifstream{ path, std::ios::binary | std::ios::ate };
+
+    if (!file)
+        return std::unexpected{ std::format("Failed to open {}.", path.string()) };
+
+    const auto size = static_cast<usize>(file.tellg());
+    auto data = std::vector<std::byte>(size);
+
+    file.seekg(0);
+
+    if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(size)))
+        return std::unexpected{ std::format("Failed to read {}.", path.string()) };
+
+    auto reader = ByteReader{ data };
+    const auto file_magic = reader.read<Magic>();
+    const auto file_version = reader.read<u32>();
+    const auto width = reader.read<u32>();
+    const auto height = reader.read<u32>();
+
+    if (reader.failed() || file_magic != magic)
+        return std::unexpected{ std::format("{} isn't a command stream.", path.string()) };
+
+    if (file_version != version)
+        return std::unexpected{ std::format("{} has version {}, expected {}.", path.string(), file_version, version) };
+
+    if (width == 0 || height == 0)
+        return std::unexpected{ std::format("{} has an empty render target size.", path.string()) };
+
+    const auto commands_offset = reader.offset();
+
+    return CommandStream{ std::move(data), commands_offset, width, height };
+}
+
+CommandStream::CommandStream(std::vector<std::byte> data, usize commands_offset, u32 width, u32 height)
+    : _data{ std::move(data) }, _commands_offset{ commands_offset }, _width{ width }, _height{ height }
+{}
+
+auto CommandStream::replay(VulkanRenderer& renderer) const -> std::expected<ReplayStats, std::string>
+{
+    auto reader = ByteReader{ std::span{ _data }.subspan(_commands_offset) };
+
+    // Recorded handles to the renderer's handles.
+    auto meshes = std::unordered_map<u32, MeshHandle>{};
+    auto textures = std::unordered_map<u32, TextureHandle>{};
+
+    // Reused between records.
+    auto lod_vertices = std::vector<std::vector<Vertex>>{};
+    auto lod_indices = std::vector<std::vector<u32>>{};
+    auto lods = std::vector<MeshLod>{};
+
+    auto stats = ReplayStats{
+        .frame_count = 0,
+        .command_count = 0,
+        .duration = {},
+        .min_frame_time = std::chrono::nanoseconds::max(),
+        .average_frame_time = {},
+        .max_frame_time = {},
+    };
+
+    auto total_frame_time = std::chrono::nanoseconds{};
+    const auto start_time = Clock::now();
+
+    auto invalid_record = [&reader, this](std::string_view reason) {
+        return std::unexpected{
+            std::format("Invalid command stream at byte {}: {}.", _commands_offset + reader.offset(), reason)
+        };
+    };
+
+    auto replay_records = [&]() -> std::expected<void, std::string> {
+        while (!reader.at_end())
+        {
+            const auto opcode = static_cast<Opcode>(reader.read<u8>());
+
+            switch (opcode)
+            {
+            case Opcode::CreateMesh:
+            {
+                const auto recorded_mesh = reader.read_u32();
+                const auto lod_count = reader.read_varint();
+
+                // Bounded by the stream size, since every LOD takes at least two bytes.
+                if (reader.failed() || lod_count > _data.size())
+                    return invalid_record("truncated mesh");
+
+                lod_vertices.resize(lod_count);
+                lod_indices.resize(lod_count);
+                lods.clear();
+
+                for (usize i = 0; i < lod_count; i++)
+                {
+                    const auto vertex_count = reader.read_varint();
+                    const auto index_count = reader.read_varint();
+
+                    read_array(reader, vertex_count, lod_vertices[i]);
+                    read_array(reader, index_count, lod_indices[i]);
+
+                    if (reader.failed())
+                        return invalid_record("truncated mesh");
+
+                    lods.push_back(MeshLod{ .vertices = lod_vertices[i], .indices = lod_indices[i] });
+                }
+
+                auto mesh = renderer.create_mesh(lods);
+
+                if (!mesh)
+                    return std::unexpected{ std::format("Failed to create a mesh: {}", mesh.error()) };
+
+                meshes[recorded_mesh] = *mesh;
+                break;
+            }
+            case Opcode::DestroyMesh:
+            {
+                const auto mesh = meshes.find(reader.read_u32());
+
+                if (reader.failed() || mesh == meshes.end())
+                    return invalid_record("unknown mesh");
+
+                renderer.destroy_mesh(mesh->second);
+                meshes.erase(mesh);
+                break;
+            }
+            case Opcode::CreateTexture:
+            {
+                const auto recorded_texture = reader.read_u32();
+                const auto width = reader.read_u32();
+                const auto height = reader.read_u32();
+
+                if (reader.failed())
+                    return invalid_record("truncated texture");
+
+                if (width == 0 || height == 0)
+                    return invalid_record("empty texture");
+
+                // The pixel count can't wrap, but the byte count could, so it's bounded by the stream size first.
+                if (usize{ width } * height > reader.remaining() / 4)
+                    return invalid_record("truncated texture");
+
+                // Pixels are passed straight from the stream, without copying them first.
+                const auto pixels = reader.read_bytes(usize{ width } * height * 4);
+
+                if (reader.failed())
+                    return invalid_record("truncated texture");
+
+                auto texture = renderer.create_texture(width, height, pixels);
+
+                if (!texture)
+                    return std::unexpected{ std::format("Failed to create a texture: {}", texture.error()) };
+
+                textures[recorded_texture] = *texture;
+                break;
+            }
+            case Opcode::DestroyTexture:
+            {
+                const auto texture = textures.find(reader.read_u32());
+
+                if (reader.failed() || texture == textures.end())
+                    return invalid_record("unknown texture");
+
+                renderer.destroy_texture(texture->second);
+                textures.erase(texture);
+                break;
+            }
+            case Opcode::SetCamera:
+            {
+                const auto view = reader.read<Mat4>();
+                const auto projection = reader.read<Mat4>();
+
+                if (reader.failed())
+                    return invalid_record("truncated camera");
+
+                renderer.set_camera(Camera{ .view = view, .projection = projection });
+                break;
+            }
+            case Opcode::SubmitDraw:
+            {
+                const auto mesh = meshes.find(reader.read_u32());
+                const auto lod = reader.read_u32();
+                const auto recorded_texture = reader.read_varint();
+                const auto transform = reader.read<Mat4>();
+
+                if (reader.failed())
+                    return invalid_record("truncated draw");
+
+                if (mesh == meshes.end())
+                    return invalid_record("draw of an unknown mesh");
+
+                auto texture = std::optional<TextureHandle>{};
+
+                if (recorded_texture != 0)
+                {
+                    if (recorded_texture - 1 > std::numeric_limits<u32>::max())
+                        return invalid_record("draw with an unknown texture");
+
+                    const auto replayed_texture = textures.find(static_cast<u32>(recorded_texture - 1));
+
+                    if (replayed_texture == textures.end())
+                        return invalid_record("draw with an unknown texture");
+
+                    texture = replayed_texture->second;
+                }
+
+                renderer.submit_draw(mesh->second, lod, transform, texture);
+                break;
+            }
+            case Opcode::SubmitLight:
+            {
+                const auto light = read_point_light(reader);
+
+                if (reader.failed())
+                    return invalid_record("truncated light");
+
+                renderer.submit_light(light);
+                break;
+            }
+            case Opcode::SetEvictionWatermarks:
+            {
+                const auto high_watermark = reader.read<f32>();
+                const auto low_watermark = reader.read<f32>();
+
+                if (reader.failed())
+                    return invalid_record("truncated eviction watermarks");
+
+                if (!(0.0f < low_watermark && low_watermark <= high_watermark && high_watermark <= 1.0f))
+                    return invalid_record("invalid eviction watermarks");
+
+                renderer.set_eviction_watermarks(high_watermark, low_watermark);
+                break;
+            }
+            case Opcode::RenderFrame:
+            {
+                const auto frame_start = Clock::now();
+
+                if (auto render_frame_result = renderer.render_frame(); !render_frame_result)
+                    return std::unexpected{ std::format("Failed to render frame {}: {}", stats.frame_count,
+                                                        render_frame_result.error()) };
+
+                const auto frame_time =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame_start);
+
+                stats.min_frame_time = std::min(stats.min_frame_time, frame_time);
+                stats.max_frame_time = std::max(stats.max_frame_time, frame_time);
+                total_frame_time += frame_time;
+                stats.frame_count++;
+                break;
+            }
+            default:
+                return invalid_record(reader.failed() ? "truncated record" : "unknown opcode");
+            }
+
+            stats.command_count++;
+        }
+
+        return {};
+    };
+
+    auto replay_result = replay_records();
+
+    // Also on failure, so that the renderer doesn't keep the resources of a replay that was cut short.
+    for (const auto& [recorded_mesh, mesh] : meshes)
+        renderer.destroy_mesh(mesh);
+
+    for (const auto& [recorded_texture, texture] : textures)
+        renderer.destroy_texture(texture);
+
+    if (!replay_result)
+        return std::unexpected{ replay_result.error() };
+
+    // render_frame() returns as soon as a frame is submitted, so the last frames may still be running on the GPU.
+    if (auto wait_result = renderer.wait_for_gpu(); !wait_result)
+        return std::unexpected{ std::format("Failed to wait for the GPU: {}", wait_result.error()) };
+
+    stats.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time);
+
+    if (stats.frame_count > 0)
+        stats.average_frame_time = total_frame_time / static_cast<i64>(stats.frame_count);
+    else
+        stats.min_frame_time = {};
+
+    return stats;
+}
+
+} // namespace renderer
@@ -0,0 +1,24 @@
+#include "renderer/deletion_queue.hpp"
+
+#include <chrono>
+
+namespace renderer {
+
+auto DeletionQueue::process(u64 completed_timeline_value, std::chrono::nanoseconds time_budget) -> usize
+{
+    const auto deadline = std::chrono::steady_clock::now() + time_budget;
+    auto destroyed_count = usize{ 0 };
+
+    while (!_entries.empty() && _entries.front().timeline_value <= completed_timeline_value)
+    {
+        _entries.pop_front();
+        destroyed_count++;
+
+        if (std::chrono::steady_clock::now() >= deadline)
+            break;
+    }
+
+    return destroyed_count;
+}
+
+} // namespace renderer
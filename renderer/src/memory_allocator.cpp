@@ -0,0 +1,359 @@
+#include "renderer/memory_allocator.hpp"
+
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+#include <algorithm>
+#include <expected>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "renderer/assert.hpp"
+#include "renderer/common.hpp"
+
+namespace renderer {
+
+namespace {
+
+// Blocks never take up more than 1 / min_blocks_per_heap of their heap, so that small heaps (e.g. the 256 MiB of
+// host-visible device-local memory without resizable BAR) aren't exhausted by a few partially used blocks.
+constexpr vk::DeviceSize min_blocks_per_heap = 8;
+
+auto align_up(vk::DeviceSize value, vk::DeviceSize alignment) -> vk::DeviceSize
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+MemoryAllocator::MemoryAllocator(const vk::PhysicalDeviceMemoryProperties& memory_properties,
+                                 vk::DeviceSize non_coherent_atom_size)
+    : _memory_properties{ memory_properties }, _non_coherent_atom_size{ non_coherent_atom_size }
+{}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    // Empty blocks are kept around for reuse, but every allocation should have been returned by now.
+    RENDERER_ASSERT(std::ranges::all_of(_allocated_bytes, [](vk::DeviceSize bytes) { return bytes == 0; }));
+}
+
+auto MemoryAllocator::allocate(const vk::raii::Device& device, const vk::MemoryRequirements& requirements,
+                               u32 memory_type_index, bool optimal_tiling)
+    -> std::expected<MemoryAllocation, std::string>
+{
+    RENDERER_ASSERT(memory_type_index < _memory_properties.memoryTypeCount);
+
+    const auto& memory_type = _memory_properties.memoryTypes[memory_type_index];
+    const auto pool_index = memory_type_index * 2 + (optimal_tiling ? 1u : 0u);
+
+    auto size = requirements.size;
+    auto alignment = requirements.alignment;
+
+    // Invalidated ranges of non-coherent memory have to be aligned to the atom size. Padding allocations to it keeps
+    // an invalidation from reaching into the neighbouring allocations.
+    if ((memory_type.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        && !(memory_type.propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent))
+    {
+        size = align_up(size, _non_coherent_atom_size);
+        alignment = std::max(alignment, _non_coherent_atom_size);
+    }
+
+    if (size > block_size(memory_type.heapIndex) / 2)
+    {
+        auto block = create_block(device, memory_type_index, pool_index, size, true);
+
+        if (!block)
+            return std::unexpected{ block.error() };
+
+        auto allocation = allocate_from_block(**block, size, alignment);
+        RENDERER_ASSERT(allocation);
+
+        return std::move(*allocation);
+    }
+
+    for (auto& block : _pools[pool_index].blocks)
+    {
+        if (block->dedicated)
+            continue;
+
+        if (auto allocation = allocate_from_block(*block, size, alignment))
+            return std::move(*allocation);
+    }
+
+    auto block = create_block(device, memory_type_index, pool_index, block_size(memory_type.heapIndex), false);
+
+    if (!block)
+        return std::unexpected{ block.error() };
+
+    auto allocation = allocate_from_block(**block, size, alignment);
+    RENDERER_ASSERT(allocation);
+
+    return std::move(*allocation);
+}
+
+auto MemoryAllocator::retire(MemoryAllocation& allocation) -> void
+{
+    if (!allocation._block || allocation._retired)
+        return;
+
+    allocation._retired = true;
+    _retired_bytes[allocation._block->heap_index] += allocation._size;
+}
+
+auto MemoryAllocator::invalidate(const vk::raii::Device& device, const MemoryAllocation& allocation) const
+    -> std::expected<void, std::string>
+{
+    if (!allocation._block || (allocation.property_flags() & vk::MemoryPropertyFlagBits::eHostCoherent))
+        return {};
+
+    // The offset and size are multiples of the atom size, see allocate().
+    const auto memory_range = vk::MappedMemoryRange{
+        .memory = allocation.memory(),
+        .offset = allocation.offset(),
+        .size = allocation.size(),
+    };
+
+    if (auto invalidate_result = device.invalidateMappedMemoryRanges(memory_range);
+        invalidate_result != vk::Result::eSuccess)
+    {
+        return std::unexpected{ vk::to_string(invalidate_result) };
+    }
+
+    return {};
+}
+
+auto MemoryAllocator::reserved_bytes(u32 heap_index) const -> vk::DeviceSize
+{
+    return _reserved_bytes[heap_index];
+}
+
+auto MemoryAllocator::allocated_bytes(u32 heap_index) const -> vk::DeviceSize
+{
+    return _allocated_bytes[heap_index];
+}
+
+auto MemoryAllocator::retired_bytes(u32 heap_index) const -> vk::DeviceSize
+{
+    return _retired_bytes[heap_index];
+}
+
+auto MemoryAllocator::expected_growth(u32 memory_type_index, bool optimal_tiling, vk::DeviceSize size) const
+    -> vk::DeviceSize
+{
+    RENDERER_ASSERT(memory_type_index < _memory_properties.memoryTypeCount);
+
+    const auto shared_block_size = block_size(_memory_properties.memoryTypes[memory_type_index].heapIndex);
+
+    if (size > shared_block_size / 2)
+        return size;
+
+    const auto pool_index = memory_type_index * 2 + (optimal_tiling ? 1u : 0u);
+
+    for (auto& block : _pools[pool_index].blocks)
+    {
+        if (!block->dedicated
+            && std::ranges::any_of(block->free_ranges, [size](const Range& range) { return range.size >= size; }))
+        {
+            return 0;
+        }
+    }
+
+    return shared_block_size;
+}
+
+auto MemoryAllocator::create_block(const vk::raii::Device& device, u32 memory_type_index, u32 pool_index,
+                                   vk::DeviceSize size, bool dedicated) -> std::expected<Block*, std::string>
+{
+    const auto memory_allocate_info = vk::MemoryAllocateInfo{
+        .allocationSize = size,
+        .memoryTypeIndex = memory_type_index,
+    };
+
+    auto [allocate_memory_result, memory] = device.allocateMemory(memory_allocate_info);
+
+    if (allocate_memory_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(allocate_memory_result) };
+
+    const auto& memory_type = _memory_properties.memoryTypes[memory_type_index];
+
+    auto block = std::make_unique<Block>(Block{
+        .memory = std::move(memory),
+        .size = size,
+        .pool_index = pool_index,
+        .heap_index = memory_type.heapIndex,
+        .property_flags = memory_type.propertyFlags,
+        .dedicated = dedicated,
+        .free_ranges = { Range{ .offset = 0, .size = size } },
+    });
+
+    if (memory_type.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+    {
+        auto [map_memory_result, mapped] = block->memory.mapMemory(0, vk::WholeSize);
+
+        if (map_memory_result != vk::Result::eSuccess)
+            return std::unexpected{ vk::to_string(map_memory_result) };
+
+        block->mapped = static_cast<std::byte*>(mapped);
+    }
+
+    _reserved_bytes[memory_type.heapIndex] += size;
+    _block_count++;
+
+    return _pools[pool_index].blocks.emplace_back(std::move(block)).get();
+}
+
+auto MemoryAllocator::allocate_from_block(Block& block, vk::DeviceSize size, vk::DeviceSize alignment)
+    -> std::optional<MemoryAllocation>
+{
+    auto& ranges = block.free_ranges;
+
+    // First fit. Blocks hold at most a few hundred ranges, since large resources get dedicated blocks.
+    for (auto range = ranges.begin(); range != ranges.end(); ++range)
+    {
+        const auto offset = align_up(range->offset, alignment);
+        const auto range_begin = range->offset;
+        const auto range_end = range->offset + range->size;
+
+        if (offset + size > range_end)
+            continue;
+
+        // Whatever is left before (alignment padding) and after the allocation stays free.
+        if (offset + size < range_end)
+        {
+            range->offset = offset + size;
+            range->size = range_end - range->offset;
+
+            if (offset > range_begin)
+                ranges.insert(range, Range{ .offset = range_begin, .size = offset - range_begin });
+        }
+        else if (offset > range_begin)
+        {
+            range->size = offset - range_begin;
+        }
+        else
+        {
+            ranges.erase(range);
+        }
+
+        block.allocated_bytes += size;
+        _allocated_bytes[block.heap_index] += size;
+
+        return MemoryAllocation{ this, &block, offset, size };
+    }
+
+    return std::nullopt;
+}
+
+auto MemoryAllocator::free(Block& block, vk::DeviceSize offset, vk::DeviceSize size, bool retired) -> void
+{
+    auto& ranges = block.free_ranges;
+    auto next = std::ranges::upper_bound(ranges, offset, {}, &Range::offset);
+    const auto merges_previous = next != ranges.begin() && std::prev(next)->offset + std::prev(next)->size == offset;
+    const auto merges_next = next != ranges.end() && offset + size == next->offset;
+
+    if (merges_previous && merges_next)
+    {
+        std::prev(next)->size += size + next->size;
+        ranges.erase(next);
+    }
+    else if (merges_previous)
+    {
+        std::prev(next)->size += size;
+    }
+    else if (merges_next)
+    {
+        next->offset = offset;
+        next->size += size;
+    }
+    else
+    {
+        ranges.insert(next, Range{ .offset = offset, .size = size });
+    }
+
+    RENDERER_ASSERT(block.allocated_bytes >= size);
+    block.allocated_bytes -= size;
+    _allocated_bytes[block.heap_index] -= size;
+
+    if (retired)
+        _retired_bytes[block.heap_index] -= size;
+
+    if (block.allocated_bytes > 0)
+        return;
+
+    // The last shared block of a pool is kept, so that memory that's repeatedly emptied and refilled (like staging
+    // buffers) doesn't cause an allocation every frame.
+    const auto& blocks = _pools[block.pool_index].blocks;
+    const auto shared_block_count =
+        std::ranges::count_if(blocks, [](const std::unique_ptr<Block>& pool_block) { return !pool_block->dedicated; });
+
+    if (block.dedicated || shared_block_count > 1)
+        destroy_block(block);
+}
+
+auto MemoryAllocator::destroy_block(Block& block) -> void
+{
+    auto& blocks = _pools[block.pool_index].blocks;
+    auto position = std::ranges::find_if(
+        blocks, [&block](const std::unique_ptr<Block>& pool_block) { return pool_block.get() == &block; });
+    RENDERER_ASSERT(position != blocks.end());
+
+    _reserved_bytes[block.heap_index] -= block.size;
+    _block_count--;
+
+    // Freeing the memory also unmaps it.
+    blocks.erase(position);
+}
+
+auto MemoryAllocator::block_size(u32 heap_index) const -> vk::DeviceSize
+{
+    return std::min(default_block_size, _memory_properties.memoryHeaps[heap_index].size / min_blocks_per_heap);
+}
+
+MemoryAllocation::MemoryAllocation(MemoryAllocator* allocator, MemoryAllocator::Block* block, vk::DeviceSize offset,
+                                   vk::DeviceSize size)
+    : _allocator{ allocator }, _block{ block }, _offset{ offset }, _size{ size }
+{}
+
+MemoryAllocation::~MemoryAllocation()
+{
+    reset();
+}
+
+MemoryAllocation::MemoryAllocation(MemoryAllocation&& other) noexcept
+    : _allocator{ std::exchange(other._allocator, nullptr) }, _block{ std::exchange(other._block, nullptr) },
+      _offset{ std::exchange(other._offset, 0) }, _size{ std::exchange(other._size, 0) },
+      _retired{ std::exchange(other._retired, false) }
+{}
+
+auto MemoryAllocation::operator=(MemoryAllocation&& other) noexcept -> MemoryAllocation&
+{
+    if (this == &other)
+        return *this;
+
+    reset();
+
+    _allocator = std::exchange(other._allocator, nullptr);
+    _block = std::exchange(other._block, nullptr);
+    _offset = std::exchange(other._offset, 0);
+    _size = std::exchange(other._size, 0);
+    _retired = std::exchange(other._retired, false);
+
+    return *this;
+}
+
+auto MemoryAllocation::reset() -> void
+{
+    if (_allocator)
+        _allocator->free(*_block, _offset, _size, _retired);
+
+    _allocator = nullptr;
+    _block = nullptr;
+    _offset = 0;
+    _size = 0;
+    _retired = false;
+}
+
+} // namespace renderer
@@ -6,9 +6,15 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <expected>
+#include <filesystem>
 #include <format>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <ranges>
 #include <span>
@@ -22,11 +28,61 @@
 #include "renderer/assert.hpp"
 #include "renderer/common.hpp"
 #include "renderer/log.hpp"
+#include "renderer/math.hpp"
 
 namespace renderer {
 
 namespace {
 
+constexpr auto forward_vertex_shader = std::to_array<u32>({
+#include "forward.vert.spv.inc"
+});
+
+constexpr auto forward_fragment_shader = std::to_array<u32>({
+#include "forward.frag.spv.inc"
+});
+
+constexpr auto cluster_lights_compute_shader = std::to_array<u32>({
+#include "cluster_lights.comp.spv.inc"
+});
+
+// Matches local_size_x in cluster_lights.comp.
+constexpr u32 light_binning_workgroup_size = 64;
+
+// Used for the depth range of the cluster grid when it can't be derived from the camera's projection.
+constexpr auto fallback_cluster_near_plane = 0.1f;
+constexpr auto fallback_cluster_far_plane = 1000.0f;
+
+// The following match the declarations in clustered_lighting.glsl and cluster_lights.comp.
+
+struct FrameUniforms
+{
+    Mat4 view;
+    Mat4 projection;
+    std::array<u32, 4> cluster_grid;
+    Vec4 cluster_depth;
+    Vec4 cluster_tile;
+};
+
+struct GpuPointLight
+{
+    Vec4 position_radius;
+    Vec4 color_intensity;
+};
+
+struct GpuClusterStats
+{
+    u32 light_index_count;
+    u32 max_cluster_light_count;
+    u32 occupied_cluster_count;
+    u32 overflowed_cluster_count;
+    std::array<u32, cluster_histogram_bins> histogram;
+};
+
+// Without VK_EXT_memory_budget we can't know how much memory other processes use, so we assume that we can only use
+// this fraction of each heap.
+constexpr auto fallback_budget_fraction = 0.8;
+
 auto VKAPI_ATTR VKAPI_CALL vk_debug_utils_callback(vk::DebugUtilsMessageSeverityFlagBitsEXT severity,
                                                    vk::DebugUtilsMessageTypeFlagsEXT type,
                                                    const vk::DebugUtilsMessengerCallbackDataEXT* callback_data,
@@ -68,9 +124,156 @@ auto VKAPI_ATTR VKAPI_CALL vk_debug_utils_callback(vk::DebugUtilsMessageSeverity
     return vk::False;
 }
 
+auto to_vk_present_mode(PresentMode present_mode) -> vk::PresentModeKHR
+{
+    switch (present_mode)
+    {
+        using enum PresentMode;
+    case Fifo:
+        return vk::PresentModeKHR::eFifo;
+    case FifoRelaxed:
+        return vk::PresentModeKHR::eFifoRelaxed;
+    case Mailbox:
+        return vk::PresentModeKHR::eMailbox;
+    case Immediate:
+        return vk::PresentModeKHR::eImmediate;
+    }
+
+    RENDERER_ASSERT(false);
+    return vk::PresentModeKHR::eFifo;
+}
+
+auto image_layout_barrier(vk::Image image, vk::ImageLayout old_layout, vk::ImageLayout new_layout,
+                          vk::PipelineStageFlags2 src_stage, vk::AccessFlags2 src_access,
+                          vk::PipelineStageFlags2 dst_stage, vk::AccessFlags2 dst_access,
+                          vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor) -> vk::ImageMemoryBarrier2
+{
+    return vk::ImageMemoryBarrier2{
+        .srcStageMask = src_stage,
+        .srcAccessMask = src_access,
+        .dstStageMask = dst_stage,
+        .dstAccessMask = dst_access,
+        .oldLayout = old_layout,
+        .newLayout = new_layout,
+        .image = image,
+        .subresourceRange = { .aspectMask = aspect,
+                              .baseMipLevel = 0,
+                              .levelCount = 1,
+                              .baseArrayLayer = 0,
+                              .layerCount = 1 },
+    };
+}
+
+template<typename T>
+auto insert_into_free_slot(std::vector<std::optional<T>>& slots, std::vector<u32>& free_slots, T&& value) -> u32
+{
+    if (free_slots.empty())
+    {
+        slots.emplace_back(std::move(value));
+        return static_cast<u32>(slots.size() - 1);
+    }
+
+    const auto index = free_slots.back();
+    free_slots.pop_back();
+    slots[index].emplace(std::move(value));
+    return index;
+}
+
 } // namespace
 
-auto VulkanRenderer::create_glfw(const char* application_name, GLFWwindow* window)
+auto to_string(PresentMode present_mode) -> std::string_view
+{
+    switch (present_mode)
+    {
+        using enum PresentMode;
+    case Fifo:
+        return "Fifo";
+    case FifoRelaxed:
+        return "FifoRelaxed";
+    case Mailbox:
+        return "Mailbox";
+    case Immediate:
+        return "Immediate";
+    }
+
+    RENDERER_ASSERT(false);
+    return "ERROR - UNEXPECTED PRESENT MODE";
+}
+
+auto VulkanRenderer::create_glfw(const char* application_name, GLFWwindow* window, PresentMode present_mode)
+    -> std::expected<VulkanRenderer, std::string>
+{
+    RENDERER_ASSERT(window != nullptr);
+
+    auto renderer = create(application_name, window);
+
+    if (!renderer)
+        return std::unexpected{ renderer.error() };
+
+    auto surface_format = choose_surface_format(renderer->_physical_device, renderer->_surface);
+
+    if (!surface_format)
+        return std::unexpected{ surface_format.error() };
+
+    auto [present_modes_result, present_modes] =
+        renderer->_physical_device.getSurfacePresentModesKHR(*renderer->_surface);
+
+    if (present_modes_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(present_modes_result) };
+
+    renderer->_surface_format = *surface_format;
+    renderer->_supported_present_modes = std::move(present_modes);
+    renderer->set_present_mode(present_mode);
+
+    if (auto create_forward_pass_result = renderer->create_forward_pass(); !create_forward_pass_result)
+        return std::unexpected{ create_forward_pass_result.error() };
+
+    auto swapchain = renderer->create_swapchain(nullptr);
+
+    if (!swapchain)
+        return std::unexpected{ swapchain.error() };
+
+    // Otherwise the window has no area yet, and the swapchain is created by the first frame that has one.
+    if (*swapchain)
+        renderer->_swapchain = std::move(**swapchain);
+
+    return renderer;
+}
+
+auto VulkanRenderer::create_headless(const char* application_name, u32 width, u32 height)
+    -> std::expected<VulkanRenderer, std::string>
+{
+    auto renderer = create(application_name, nullptr);
+
+    if (!renderer)
+        return std::unexpected{ renderer.error() };
+
+    const auto extent = vk::Extent2D{ .width = width, .height = height };
+
+    auto offscreen_target =
+        renderer->create_image(extent, offscreen_target_format,
+                               vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+                               vk::ImageAspectFlagBits::eColor);
+
+    if (!offscreen_target)
+        return std::unexpected{ offscreen_target.error() };
+
+    auto offscreen_depth = renderer->create_image(extent, depth_format, vk::ImageUsageFlagBits::eDepthStencilAttachment,
+                                                  vk::ImageAspectFlagBits::eDepth);
+
+    if (!offscreen_depth)
+        return std::unexpected{ offscreen_depth.error() };
+
+    renderer->_offscreen_target = std::move(*offscreen_target);
+    renderer->_offscreen_depth = std::move(*offscreen_depth);
+
+    if (auto create_forward_pass_result = renderer->create_forward_pass(); !create_forward_pass_result)
+        return std::unexpected{ create_forward_pass_result.error() };
+
+    return renderer;
+}
+
+auto VulkanRenderer::create(const char* application_name, GLFWwindow* window)
     -> std::expected<VulkanRenderer, std::string>
 {
     auto context = vk::raii::Context{};
@@ -82,7 +285,7 @@ auto VulkanRenderer::create_glfw(const char* application_name, GLFWwindow* windo
 
     RENDERER_INFO("");
 
-    const auto extensions = get_vulkan_extensions();
+    const auto extensions = get_vulkan_extensions(window != nullptr);
     auto validate_extensions_result = validate_extensions(context, extensions);
     if (!validate_extensions_result)
         return std::unexpected{ validate_extensions_result.error() };
@@ -127,38 +330,349 @@ auto VulkanRenderer::create_glfw(const char* application_name, GLFWwindow* windo
         debug_messenger = std::move(*create_debug_messenger_result);
     }
 
-    auto surface = create_surface(instance, window);
+    auto surface = vk::raii::SurfaceKHR{ nullptr };
+
+    if (window)
+    {
+        auto create_surface_result = create_surface(instance, window);
+
+        if (!create_surface_result)
+            return std::unexpected{ create_surface_result.error() };
 
-    if (!surface)
-        return std::unexpected{ surface.error() };
+        surface = std::move(*create_surface_result);
+    }
 
-    auto physical_device = pick_physical_device(instance);
+    auto physical_device = pick_physical_device(instance, window != nullptr);
     RENDERER_INFO("");
 
     if (!physical_device)
         return std::unexpected{ physical_device.error() };
 
-    auto create_device_result = create_device(*physical_device);
+    auto device_extensions = get_device_extensions(*physical_device, window != nullptr);
+
+    if (!device_extensions)
+        return std::unexpected{ device_extensions.error() };
+
+    auto create_device_result = create_device(*physical_device, *device_extensions);
 
     if (!create_device_result)
         return std::unexpected{ create_device_result.error() };
 
     auto [device, graphics_queue] = std::move(*create_device_result);
 
-    return VulkanRenderer{ std::move(context),          std::move(instance), std::move(*surface),
-                           std::move(*physical_device), std::move(device),   std::move(graphics_queue),
-                           std::move(debug_messenger) };
+    const auto graphics_queue_family_index = find_graphics_queue_family(*physical_device);
+
+    if (window)
+    {
+        auto [surface_support_result, surface_supported] =
+            physical_device->getSurfaceSupportKHR(graphics_queue_family_index, *surface);
+
+        if (surface_support_result != vk::Result::eSuccess)
+            return std::unexpected{ vk::to_string(surface_support_result) };
+
+        if (!surface_supported)
+            return std::unexpected{ "The graphics queue of the picked device cannot present to the window surface." };
+    }
+
+    auto renderer = VulkanRenderer{ std::move(context),          std::move(instance), std::move(surface),
+                                    std::move(*physical_device), std::move(device),   std::move(graphics_queue),
+                                    std::move(debug_messenger),  window,              graphics_queue_family_index };
+
+    auto create_frames_result = renderer.create_frames();
+
+    if (!create_frames_result)
+        return std::unexpected{ create_frames_result.error() };
+
+    renderer._memory_budget_enabled = std::ranges::any_of(*device_extensions, [](auto& extension) {
+        return std::string_view{ extension } == vk::EXTMemoryBudgetExtensionName;
+    });
+
+    RENDERER_INFO("Memory budget tracking: {}.",
+                  renderer._memory_budget_enabled ? vk::EXTMemoryBudgetExtensionName : "estimated from heap sizes");
+
+    renderer._present_wait_enabled = std::ranges::any_of(*device_extensions, [](auto& extension) {
+        return std::string_view{ extension } == vk::KHRPresentWaitExtensionName;
+    });
+
+    const auto heap_count = renderer._physical_device.getMemoryProperties().memoryHeapCount;
+    renderer._memory_heaps.resize(heap_count);
+    renderer._polled_reserved_bytes.resize(heap_count);
+    renderer._streamed_bytes.resize(heap_count);
+
+    if (auto streaming_memory_type = renderer.find_memory_type(~0u, vk::MemoryPropertyFlagBits::eDeviceLocal, {}))
+    {
+        renderer._streaming_memory_type_index = *streaming_memory_type;
+        renderer._streaming_heap_index =
+            renderer._physical_device.getMemoryProperties().memoryTypes[*streaming_memory_type].heapIndex;
+    }
+
+    renderer.update_memory_budget();
+
+    return std::move(renderer);
 }
 
 VulkanRenderer::VulkanRenderer(vk::raii::Context&& context, vk::raii::Instance&& instance,
                                vk::raii::SurfaceKHR&& surface, vk::raii::PhysicalDevice&& physical_device,
                                vk::raii::Device&& device, vk::raii::Queue&& graphics_queue,
-                               vk::raii::DebugUtilsMessengerEXT&& debug_messenger)
+                               vk::raii::DebugUtilsMessengerEXT&& debug_messenger, GLFWwindow* window,
+                               u32 graphics_queue_family_index)
     : _context{ std::move(context) }, _instance{ std::move(instance) }, _surface{ std::move(surface) },
       _physical_device{ std::move(physical_device) }, _device{ std::move(device) },
-      _graphics_queue{ std::move(graphics_queue) }, _debug_messenger{ std::move(debug_messenger) }
+      _graphics_queue{ std::move(graphics_queue) }, _debug_messenger{ std::move(debug_messenger) },
+      _memory_allocator{ std::make_unique<MemoryAllocator>(
+          _physical_device.getMemoryProperties(), _physical_device.getProperties().limits.nonCoherentAtomSize) },
+      _window{ window }, _graphics_queue_family_index{ graphics_queue_family_index }
 {}
 
+VulkanRenderer::~VulkanRenderer()
+{
+    // Frames in flight and objects in the deletion queue may still be in use by the GPU. This is the only place where
+    // we wait for the device to go idle.
+    if (*_device)
+        std::ignore = _device.waitIdle();
+
+    if (_command_capture)
+        std::ignore = _command_capture->finish();
+}
+
+auto VulkanRenderer::notify_framebuffer_resized() -> void
+{
+    _swapchain_out_of_date = true;
+}
+
+auto VulkanRenderer::set_present_mode(PresentMode present_mode) -> void
+{
+    if (!is_present_mode_supported(present_mode))
+    {
+        RENDERER_WARNING("Present mode {} not supported, falling back to {}.", to_string(present_mode),
+                         to_string(PresentMode::Fifo));
+        present_mode = PresentMode::Fifo;
+    }
+
+    if (present_mode == _present_mode)
+        return;
+
+    RENDERER_INFO("Present mode set to {}.", to_string(present_mode));
+
+    _present_mode = present_mode;
+
+    if (*_swapchain.swapchain)
+        _swapchain_out_of_date = true;
+}
+
+auto VulkanRenderer::present_mode() const -> PresentMode
+{
+    return _present_mode;
+}
+
+auto VulkanRenderer::is_present_mode_supported(PresentMode present_mode) const -> bool
+{
+    // Fifo is required to be supported by the spec.
+    return present_mode == PresentMode::Fifo
+           || std::ranges::contains(_supported_present_modes, to_vk_present_mode(present_mode));
+}
+
+auto VulkanRenderer::supports_present_wait() const -> bool
+{
+    return _present_wait_enabled;
+}
+
+auto VulkanRenderer::last_present_id() const -> u64
+{
+    return _present_id;
+}
+
+auto VulkanRenderer::wait_for_present(u64 present_id, std::chrono::nanoseconds timeout) const
+    -> std::expected<PresentStatus, std::string>
+{
+    RENDERER_ASSERT(_present_wait_enabled);
+    RENDERER_ASSERT(present_id > 0 && present_id <= _present_id);
+
+    if (!*_swapchain.swapchain || present_id < _swapchain.first_present_id)
+        return PresentStatus::Discarded;
+
+    const auto timeout_ns = static_cast<u64>(std::max(timeout.count(), std::chrono::nanoseconds::rep{ 0 }));
+    const auto wait_result = _swapchain.swapchain.waitForPresent(present_id, timeout_ns);
+
+    switch (wait_result)
+    {
+    case vk::Result::eSuccess:
+    case vk::Result::eSuboptimalKHR:
+        return PresentStatus::Presented;
+    case vk::Result::eTimeout:
+        return PresentStatus::Pending;
+    // The swapchain will be recreated by the next frame.
+    case vk::Result::eErrorOutOfDateKHR:
+        return PresentStatus::Discarded;
+    default:
+        return std::unexpected{ vk::to_string(wait_result) };
+    }
+}
+
+auto VulkanRenderer::render_frame() -> std::expected<void, std::string>
+{
+    auto completed_value = completed_timeline_value();
+
+    if (!completed_value)
+        return std::unexpected{ completed_value.error() };
+
+    auto deliver_readbacks_result = deliver_completed_readbacks(*completed_value);
+
+    if (!deliver_readbacks_result)
+        return std::unexpected{ deliver_readbacks_result.error() };
+
+    _deletion_queue.process(*completed_value, _deletion_time_budget);
+    update_memory_budget();
+
+    if (_command_capture)
+        _command_capture->render_frame();
+
+    auto render_result = _window ? render_window_frame() : render_headless_frame();
+
+    // Draws and lights are only valid for a single frame, even if nothing was rendered.
+    _draws.clear();
+    _lights.clear();
+
+    return render_result;
+}
+
+auto VulkanRenderer::wait_for_gpu() const -> std::expected<void, std::string>
+{
+    return wait_for_timeline_value(_frame_timeline_value);
+}
+
+auto VulkanRenderer::render_window_frame() -> std::expected<void, std::string>
+{
+    if (_swapchain_out_of_date || !*_swapchain.swapchain)
+    {
+        auto recreate_swapchain_result = recreate_swapchain();
+
+        if (!recreate_swapchain_result)
+            return std::unexpected{ recreate_swapchain_result.error() };
+
+        // Nothing to render to.
+        if (!*recreate_swapchain_result)
+            return {};
+    }
+
+    auto& frame = _frames[_frame_index];
+
+    // Only blocks if the GPU is more than max_frames_in_flight frames behind.
+    if (auto wait_result = wait_for_timeline_value(frame.timeline_value); !wait_result)
+        return std::unexpected{ wait_result.error() };
+
+    auto [acquire_result, image_index] =
+        _swapchain.swapchain.acquireNextImage(std::numeric_limits<u64>::max(), *frame.image_available_semaphore);
+
+    if (acquire_result == vk::Result::eErrorOutOfDateKHR)
+    {
+        // The semaphore doesn't get signaled in this case, so the frame can simply be retried after recreation.
+        _swapchain_out_of_date = true;
+        return {};
+    }
+
+    if (acquire_result == vk::Result::eSuboptimalKHR)
+        _swapchain_out_of_date = true;
+    else if (acquire_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(acquire_result) };
+
+    auto readback_slot = acquire_readback_slot(_swapchain.extent);
+
+    if (!readback_slot)
+        return std::unexpected{ readback_slot.error() };
+
+    if (auto prepare_frame_result = prepare_frame(frame, _swapchain.extent); !prepare_frame_result)
+        return std::unexpected{ prepare_frame_result.error() };
+
+    const auto render_target = RenderTarget{
+        .image = _swapchain.images[image_index],
+        .image_view = *_swapchain.image_views[image_index],
+        .depth_image = *_swapchain.depth_image.image,
+        .depth_image_view = *_swapchain.depth_image.image_view,
+        .extent = _swapchain.extent,
+        .final_layout = vk::ImageLayout::ePresentSrcKHR,
+    };
+
+    auto record_frame_result = record_frame(frame, render_target, *readback_slot);
+
+    if (!record_frame_result)
+        return std::unexpected{ record_frame_result.error() };
+
+    const auto& render_finished_semaphore = _swapchain.render_finished_semaphores[image_index];
+
+    auto submit_frame_result =
+        submit_frame(frame, *frame.image_available_semaphore, *render_finished_semaphore, *readback_slot);
+
+    if (!submit_frame_result)
+        return std::unexpected{ submit_frame_result.error() };
+
+    const auto present_id = _present_id + 1;
+    const auto present_id_info = vk::PresentIdKHR{ .swapchainCount = 1, .pPresentIds = &present_id };
+
+    const auto present_info = vk::PresentInfoKHR{
+        .pNext = _present_wait_enabled ? &present_id_info : nullptr,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &*render_finished_semaphore,
+        .swapchainCount = 1,
+        .pSwapchains = &*_swapchain.swapchain,
+        .pImageIndices = &image_index,
+    };
+
+    auto present_result = _graphics_queue.presentKHR(present_info);
+
+    if (present_result == vk::Result::eSuccess || present_result == vk::Result::eSuboptimalKHR)
+        _present_id = present_id;
+
+    if (present_result == vk::Result::eErrorOutOfDateKHR || present_result == vk::Result::eSuboptimalKHR)
+        _swapchain_out_of_date = true;
+    else if (present_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(present_result) };
+
+    return {};
+}
+
+auto VulkanRenderer::enable_frame_readback(u32 ring_size, ReadbackCallback callback)
+    -> std::expected<void, std::string>
+{
+    if (ring_size == 0)
+        return std::unexpected{ "The readback ring needs at least one slot." };
+
+    if (!readback_pixel_format())
+        return std::unexpected{ std::format("Reading back frames in format {} is not supported.",
+                                            vk::to_string(render_target_format())) };
+
+    if (_window && !(_swapchain.usage & vk::ImageUsageFlagBits::eTransferSrc))
+        return std::unexpected{ "The swapchain images of the window surface can't be copied from." };
+
+    if (auto disable_result = disable_frame_readback(); !disable_result)
+        return std::unexpected{ disable_result.error() };
+
+    // Buffers are created lazily when a slot is first used.
+    _readback_slots.resize(ring_size);
+    _readback_slot_index = 0;
+    _readback_callback = std::move(callback);
+
+    return {};
+}
+
+auto VulkanRenderer::disable_frame_readback() -> std::expected<void, std::string>
+{
+    if (_readback_slots.empty())
+        return {};
+
+    if (auto wait_result = wait_for_timeline_value(_frame_timeline_value); !wait_result)
+        return std::unexpected{ wait_result.error() };
+
+    if (auto deliver_result = deliver_completed_readbacks(_frame_timeline_value); !deliver_result)
+        return std::unexpected{ deliver_result.error() };
+
+    _readback_slots.clear();
+    _readback_slot_index = 0;
+    _readback_callback = nullptr;
+
+    return {};
+}
+
 auto VulkanRenderer::get_vulkan_layers() -> std::vector<const char*>
 {
 #if defined(RND_VK_VALIDATION_LAYERS)
@@ -168,13 +682,18 @@ auto VulkanRenderer::get_vulkan_layers() -> std::vector<const char*>
 #endif
 }
 
-auto VulkanRenderer::get_vulkan_extensions() -> std::vector<const char*>
+auto VulkanRenderer::get_vulkan_extensions(bool surface_support) -> std::vector<const char*>
 {
-    u32 glfw_extension_count = 0;
-    auto glfw_extensions_ptr = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
-    auto glfw_extensions = std::span{ glfw_extensions_ptr, glfw_extension_count };
+    auto extensions = std::vector<const char*>{};
+
+    if (surface_support)
+    {
+        u32 glfw_extension_count = 0;
+        auto glfw_extensions_ptr = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+        auto glfw_extensions = std::span{ glfw_extensions_ptr, glfw_extension_count };
 
-    auto extensions = std::vector<const char*>{ glfw_extensions.begin(), glfw_extensions.end() };
+        extensions.insert(extensions.end(), glfw_extensions.begin(), glfw_extensions.end());
+    }
 
 #if defined(RND_VK_DEBUG_UTILS)
     extensions.push_back(vk::EXTDebugUtilsExtensionName);
@@ -280,7 +799,7 @@ auto VulkanRenderer::create_surface(const vk::raii::Instance& instance, GLFWwind
     return vk::raii::SurfaceKHR{ instance, surface };
 }
 
-auto VulkanRenderer::pick_physical_device(const vk::raii::Instance& instance)
+auto VulkanRenderer::pick_physical_device(const vk::raii::Instance& instance, bool presentation)
     -> std::expected<vk::raii::PhysicalDevice, std::string>
 {
     auto [devices_result, devices] = instance.enumeratePhysicalDevices();
@@ -293,47 +812,61 @@ auto VulkanRenderer::pick_physical_device(const vk::raii::Instance& instance)
 
     RENDERER_INFO("Vulkan devices found:");
     auto picked_device = std::optional<vk::raii::PhysicalDevice>{ std::nullopt };
+    auto picked_device_is_discrete = false;
 
     for (auto& device : devices)
     {
         auto device_properties = device.getProperties();
+        RENDERER_INFO("\t{}", std::string_view{ device_properties.deviceName });
 
-        if (is_suitable(device))
-            picked_device = device;
+        auto suitable = is_suitable(device, presentation);
 
-        RENDERER_INFO("\t{}", std::string_view{ device_properties.deviceName });
+        if (!suitable || !*suitable)
+            continue;
+
+        // Discrete GPUs are preferred, but integrated and software devices (e.g. when running under a virtual X
+        // server) are accepted as a fallback.
+        const auto is_discrete = device_properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu;
+
+        if (!picked_device || (is_discrete && !picked_device_is_discrete))
+        {
+            picked_device = device;
+            picked_device_is_discrete = is_discrete;
+        }
     }
 
     if (!picked_device)
         return std::unexpected{ "No suitable device with Vulkan support found." };
 
+    RENDERER_INFO("Picked Vulkan device: {}", std::string_view{ picked_device->getProperties().deviceName });
+
     return *picked_device;
 }
 
-auto VulkanRenderer::is_suitable(const vk::PhysicalDevice& physical_device) -> std::expected<bool, std::string>
+auto VulkanRenderer::is_suitable(const vk::PhysicalDevice& physical_device, bool presentation)
+    -> std::expected<bool, std::string>
 {
     const auto device_properties = physical_device.getProperties();
 
-    if (device_properties.apiVersion < VK_API_VERSION_1_3
-        || device_properties.deviceType != vk::PhysicalDeviceType::eDiscreteGpu)
-    {
+    if (device_properties.apiVersion < VK_API_VERSION_1_3)
         return false;
-    }
 
     auto [device_extensions_result, device_extensions] = physical_device.enumerateDeviceExtensionProperties();
 
     if (device_extensions_result != vk::Result::eSuccess)
         return std::unexpected{ vk::to_string(device_extensions_result) };
 
-    for (auto& required_extension : required_device_extensions)
-    {
-        if (std::ranges::none_of(device_extensions, [&required_extension](auto& device_extension) {
-                return std::string_view{ device_extension.extensionName } == required_extension;
-            }))
-        {
-            return false;
-        }
-    }
+    auto is_supported = [&device_extensions](std::string_view extension) {
+        return std::ranges::any_of(device_extensions, [extension](auto& device_extension) {
+            return std::string_view{ device_extension.extensionName } == extension;
+        });
+    };
+
+    if (!std::ranges::all_of(required_device_extensions, is_supported))
+        return false;
+
+    if (presentation && !std::ranges::all_of(presentation_device_extensions, is_supported))
+        return false;
 
     const auto queue_family_properties = physical_device.getQueueFamilyProperties();
 
@@ -347,7 +880,49 @@ auto VulkanRenderer::is_suitable(const vk::PhysicalDevice& physical_device) -> s
     return true;
 }
 
-auto VulkanRenderer::create_device(const vk::raii::PhysicalDevice& physical_device)
+auto VulkanRenderer::get_device_extensions(const vk::raii::PhysicalDevice& physical_device, bool presentation)
+    -> std::expected<std::vector<const char*>, std::string>
+{
+    auto [device_extensions_result, device_extensions] = physical_device.enumerateDeviceExtensionProperties();
+
+    if (device_extensions_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(device_extensions_result) };
+
+    auto is_supported = [&device_extensions](std::string_view extension) {
+        return std::ranges::any_of(device_extensions, [extension](auto& device_extension) {
+            return std::string_view{ device_extension.extensionName } == extension;
+        });
+    };
+
+    auto extensions = std::vector<const char*>{ required_device_extensions.begin(), required_device_extensions.end() };
+
+    if (presentation)
+        std::ranges::copy(presentation_device_extensions, std::back_inserter(extensions));
+
+    std::ranges::copy_if(optional_device_extensions, std::back_inserter(extensions), is_supported);
+
+    if (presentation && std::ranges::all_of(present_wait_device_extensions, is_supported))
+    {
+        const auto features = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2,
+                                                           vk::PhysicalDevicePresentIdFeaturesKHR,
+                                                           vk::PhysicalDevicePresentWaitFeaturesKHR>();
+
+        if (features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId
+            && features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait)
+        {
+            std::ranges::copy(present_wait_device_extensions, std::back_inserter(extensions));
+        }
+    }
+
+    RENDERER_INFO("Enabled device extensions:");
+    for (auto& extension : extensions)
+        RENDERER_INFO("\t{}", extension);
+
+    return extensions;
+}
+
+auto VulkanRenderer::create_device(const vk::raii::PhysicalDevice& physical_device,
+                                   std::span<const char* const> extensions)
     -> std::expected<std::tuple<vk::raii::Device, vk::raii::Queue>, std::string>
 {
     auto queue_priority = 0.5f;
@@ -360,12 +935,26 @@ auto VulkanRenderer::create_device(const vk::raii::PhysicalDevice& physical_devi
         .pQueuePriorities = &queue_priority,
     };
 
-    const auto device_features = vk::StructureChain<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan13Features,
-                                                    vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>{
-        {},                              // vk::PhysicalDeviceFeatures2
-        { .dynamicRendering = true },    // vk::PhysicalDeviceVulkan13Features
-        { .extendedDynamicState = true } // vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT
-    };
+    auto device_features =
+        vk::StructureChain<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features,
+                           vk::PhysicalDeviceVulkan13Features, vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT,
+                           vk::PhysicalDevicePresentIdFeaturesKHR, vk::PhysicalDevicePresentWaitFeaturesKHR>{
+            {},                                                     // vk::PhysicalDeviceFeatures2
+            { .timelineSemaphore = true },                          // vk::PhysicalDeviceVulkan12Features
+            { .synchronization2 = true, .dynamicRendering = true }, // vk::PhysicalDeviceVulkan13Features
+            { .extendedDynamicState = true }, // vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT
+            { .presentId = true },            // vk::PhysicalDevicePresentIdFeaturesKHR
+            { .presentWait = true },          // vk::PhysicalDevicePresentWaitFeaturesKHR
+        };
+
+    // The present wait features may only be chained if their extensions are enabled.
+    if (!std::ranges::any_of(extensions, [](const char* extension) {
+            return std::string_view{ extension } == vk::KHRPresentWaitExtensionName;
+        }))
+    {
+        device_features.unlink<vk::PhysicalDevicePresentIdFeaturesKHR>();
+        device_features.unlink<vk::PhysicalDevicePresentWaitFeaturesKHR>();
+    }
 
     const auto device_create_info = vk::DeviceCreateInfo{
         .pNext = &device_features.get<vk::PhysicalDeviceFeatures2>(),
@@ -373,8 +962,8 @@ auto VulkanRenderer::create_device(const vk::raii::PhysicalDevice& physical_devi
         .pQueueCreateInfos = &device_queue_create_info,
         .enabledLayerCount = 0,
         .ppEnabledLayerNames = nullptr,
-        .enabledExtensionCount = static_cast<u32>(required_device_extensions.size()),
-        .ppEnabledExtensionNames = required_device_extensions.data(),
+        .enabledExtensionCount = static_cast<u32>(extensions.size()),
+        .ppEnabledExtensionNames = extensions.data(),
     };
 
     auto [create_device_result, device] = physical_device.createDevice(device_create_info);
@@ -401,4 +990,2103 @@ auto VulkanRenderer::find_graphics_queue_family(const vk::raii::PhysicalDevice&
     return static_cast<u32>(std::distance(queue_family_properties.begin(), found));
 }
 
+auto VulkanRenderer::choose_surface_format(const vk::raii::PhysicalDevice& physical_device,
+                                           const vk::raii::SurfaceKHR& surface)
+    -> std::expected<vk::SurfaceFormatKHR, std::string>
+{
+    auto [surface_formats_result, surface_formats] = physical_device.getSurfaceFormatsKHR(*surface);
+
+    if (surface_formats_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(surface_formats_result) };
+
+    if (surface_formats.empty())
+        return std::unexpected{ "The window surface doesn't support any formats." };
+
+    auto preferred = std::ranges::find_if(surface_formats, [](auto& surface_format) {
+        return surface_format.format == vk::Format::eB8G8R8A8Srgb
+               && surface_format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
+    });
+
+    if (preferred != std::ranges::end(surface_formats))
+        return *preferred;
+
+    return surface_formats.front();
+}
+
+auto VulkanRenderer::create_frames() -> std::expected<void, std::string>
+{
+    const auto command_pool_create_info = vk::CommandPoolCreateInfo{
+        .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+        .queueFamilyIndex = _graphics_queue_family_index,
+    };
+
+    auto [create_command_pool_result, command_pool] = _device.createCommandPool(command_pool_create_info);
+
+    if (create_command_pool_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_command_pool_result) };
+
+    _command_pool = std::move(command_pool);
+
+    const auto command_buffer_allocate_info = vk::CommandBufferAllocateInfo{
+        .commandPool = *_command_pool,
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = max_frames_in_flight,
+    };
+
+    auto [allocate_command_buffers_result, command_buffers] =
+        _device.allocateCommandBuffers(command_buffer_allocate_info);
+
+    if (allocate_command_buffers_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(allocate_command_buffers_result) };
+
+    const auto timeline_create_info = vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo>{
+        {},                                                                  // vk::SemaphoreCreateInfo
+        { .semaphoreType = vk::SemaphoreType::eTimeline, .initialValue = 0 } // vk::SemaphoreTypeCreateInfo
+    };
+
+    auto [create_timeline_result, frame_timeline] =
+        _device.createSemaphore(timeline_create_info.get<vk::SemaphoreCreateInfo>());
+
+    if (create_timeline_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_timeline_result) };
+
+    _frame_timeline = std::move(frame_timeline);
+    _frame_timeline_value = 0;
+
+    for (auto [frame, command_buffer] : std::views::zip(_frames, command_buffers))
+    {
+        auto [create_semaphore_result, image_available_semaphore] = _device.createSemaphore(vk::SemaphoreCreateInfo{});
+
+        if (create_semaphore_result != vk::Result::eSuccess)
+            return std::unexpected{ vk::to_string(create_semaphore_result) };
+
+        frame.command_buffer = std::move(command_buffer);
+        frame.image_available_semaphore = std::move(image_available_semaphore);
+        frame.timeline_value = 0;
+    }
+
+    return {};
+}
+
+auto VulkanRenderer::create_forward_pass() -> std::expected<void, std::string>
+{
+    const auto sampler_create_info = vk::SamplerCreateInfo{
+        .magFilter = vk::Filter::eLinear,
+        .minFilter = vk::Filter::eLinear,
+        .mipmapMode = vk::SamplerMipmapMode::eLinear,
+        .addressModeU = vk::SamplerAddressMode::eRepeat,
+        .addressModeV = vk::SamplerAddressMode::eRepeat,
+        .addressModeW = vk::SamplerAddressMode::eRepeat,
+        .maxLod = vk::LodClampNone,
+    };
+
+    auto [create_sampler_result, sampler] = _device.createSampler(sampler_create_info);
+
+    if (create_sampler_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_sampler_result) };
+
+    _texture_sampler = std::move(sampler);
+
+    auto frame_binding = [](u32 binding, vk::DescriptorType type, vk::ShaderStageFlags stages) {
+        return vk::DescriptorSetLayoutBinding{
+            .binding = binding,
+            .descriptorType = type,
+            .descriptorCount = 1,
+            .stageFlags = stages,
+        };
+    };
+
+    // The frame descriptor set is shared by the light binning and the forward pass.
+    const auto all_stages =
+        vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute;
+    const auto light_stages = vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute;
+
+    const auto frame_bindings = std::array{
+        frame_binding(0, vk::DescriptorType::eUniformBuffer, all_stages),
+        // Lights
+        frame_binding(1, vk::DescriptorType::eStorageBuffer, light_stages),
+        // Light grid
+        frame_binding(2, vk::DescriptorType::eStorageBuffer, light_stages),
+        // Light index list
+        frame_binding(3, vk::DescriptorType::eStorageBuffer, light_stages),
+        // Cluster stats
+        frame_binding(4, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute),
+    };
+
+    auto [create_frame_layout_result, frame_descriptor_set_layout] =
+        _device.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo{
+            .bindingCount = static_cast<u32>(frame_bindings.size()),
+            .pBindings = frame_bindings.data(),
+        });
+
+    if (create_frame_layout_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_frame_layout_result) };
+
+    _frame_descriptor_set_layout = std::move(frame_descriptor_set_layout);
+
+    const auto texture_binding = vk::DescriptorSetLayoutBinding{
+        .binding = 0,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .descriptorCount = 1,
+        .stageFlags = vk::ShaderStageFlagBits::eFragment,
+    };
+
+    auto [create_texture_layout_result, texture_descriptor_set_layout] = _device.createDescriptorSetLayout(
+        vk::DescriptorSetLayoutCreateInfo{ .bindingCount = 1, .pBindings = &texture_binding });
+
+    if (create_texture_layout_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_texture_layout_result) };
+
+    _texture_descriptor_set_layout = std::move(texture_descriptor_set_layout);
+
+    // One extra texture descriptor set for the default texture.
+    const auto pool_sizes = std::array{
+        vk::DescriptorPoolSize{ .type = vk::DescriptorType::eUniformBuffer, .descriptorCount = max_frames_in_flight },
+        vk::DescriptorPoolSize{ .type = vk::DescriptorType::eStorageBuffer,
+                                .descriptorCount = max_frames_in_flight * 4 },
+        vk::DescriptorPoolSize{ .type = vk::DescriptorType::eCombinedImageSampler,
+                                .descriptorCount = max_textures + 1 },
+    };
+
+    const auto descriptor_pool_create_info = vk::DescriptorPoolCreateInfo{
+        .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+        .maxSets = max_frames_in_flight + max_textures + 1,
+        .poolSizeCount = static_cast<u32>(pool_sizes.size()),
+        .pPoolSizes = pool_sizes.data(),
+    };
+
+    auto [create_descriptor_pool_result, descriptor_pool] = _device.createDescriptorPool(descriptor_pool_create_info);
+
+    if (create_descriptor_pool_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_descriptor_pool_result) };
+
+    _descriptor_pool = std::move(descriptor_pool);
+
+    if (auto create_frame_resources_result = create_frame_resources(); !create_frame_resources_result)
+        return std::unexpected{ create_frame_resources_result.error() };
+
+    if (auto create_light_binning_result = create_light_binning_pipeline(); !create_light_binning_result)
+        return std::unexpected{ create_light_binning_result.error() };
+
+    const auto push_constant_range = vk::PushConstantRange{
+        .stageFlags = vk::ShaderStageFlagBits::eVertex,
+        .offset = 0,
+        .size = sizeof(Mat4),
+    };
+
+    const auto set_layouts = std::array{ *_frame_descriptor_set_layout, *_texture_descriptor_set_layout };
+
+    const auto pipeline_layout_create_info = vk::PipelineLayoutCreateInfo{
+        .setLayoutCount = static_cast<u32>(set_layouts.size()),
+        .pSetLayouts = set_layouts.data(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range,
+    };
+
+    auto [create_pipeline_layout_result, pipeline_layout] = _device.createPipelineLayout(pipeline_layout_create_info);
+
+    if (create_pipeline_layout_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_pipeline_layout_result) };
+
+    _forward_pipeline_layout = std::move(pipeline_layout);
+
+    if (auto create_pipeline_result = create_forward_pipeline(); !create_pipeline_result)
+        return std::unexpected{ create_pipeline_result.error() };
+
+    // Uploaded with the first frame.
+    constexpr static auto white_pixel = std::array{ std::byte{ 0xff }, std::byte{ 0xff }, std::byte{ 0xff },
+                                                    std::byte{ 0xff } };
+
+    auto default_texture = create_gpu_texture(vk::Extent2D{ .width = 1, .height = 1 }, white_pixel);
+
+    if (!default_texture)
+        return std::unexpected{ default_texture.error() };
+
+    _default_texture = std::move(*default_texture);
+
+    return {};
+}
+
+auto VulkanRenderer::create_frame_resources() -> std::expected<void, std::string>
+{
+    constexpr static auto light_index_capacity = cluster_count * average_lights_per_cluster;
+
+    for (auto& frame : _frames)
+    {
+        auto uniform_buffer = create_dynamic_buffer(sizeof(FrameUniforms), vk::BufferUsageFlagBits::eUniformBuffer);
+
+        if (!uniform_buffer)
+            return std::unexpected{ uniform_buffer.error() };
+
+        auto light_buffer =
+            create_dynamic_buffer(sizeof(GpuPointLight) * max_lights, vk::BufferUsageFlagBits::eStorageBuffer);
+
+        if (!light_buffer)
+            return std::unexpected{ light_buffer.error() };
+
+        auto light_grid_buffer = create_buffer(sizeof(u32) * 2 * cluster_count, vk::BufferUsageFlagBits::eStorageBuffer,
+                                               MemoryUsage::GpuOnly);
+
+        if (!light_grid_buffer)
+            return std::unexpected{ light_grid_buffer.error() };
+
+        auto light_index_buffer = create_buffer(sizeof(u32) * light_index_capacity,
+                                                vk::BufferUsageFlagBits::eStorageBuffer, MemoryUsage::GpuOnly);
+
+        if (!light_index_buffer)
+            return std::unexpected{ light_index_buffer.error() };
+
+        // Cleared on the GPU at the start of every frame, and copied to the readback buffer once the lights are binned.
+        auto cluster_stats_buffer = create_buffer(sizeof(GpuClusterStats),
+                                                  vk::BufferUsageFlagBits::eStorageBuffer
+                                                      | vk::BufferUsageFlagBits::eTransferSrc
+                                                      | vk::BufferUsageFlagBits::eTransferDst,
+                                                  MemoryUsage::GpuOnly);
+
+        if (!cluster_stats_buffer)
+            return std::unexpected{ cluster_stats_buffer.error() };
+
+        // Read on the CPU once the frame has completed.
+        auto cluster_stats_readback_buffer =
+            create_buffer(sizeof(GpuClusterStats), vk::BufferUsageFlagBits::eTransferDst, MemoryUsage::Readback);
+
+        if (!cluster_stats_readback_buffer)
+            return std::unexpected{ cluster_stats_readback_buffer.error() };
+
+        auto descriptor_set = allocate_descriptor_set(*_frame_descriptor_set_layout);
+
+        if (!descriptor_set)
+            return std::unexpected{ descriptor_set.error() };
+
+        // In binding order.
+        const auto buffer_infos = std::array{
+            vk::DescriptorBufferInfo{ .buffer = *uniform_buffer->buffer.buffer, .offset = 0, .range = vk::WholeSize },
+            vk::DescriptorBufferInfo{ .buffer = *light_buffer->buffer.buffer, .offset = 0, .range = vk::WholeSize },
+            vk::DescriptorBufferInfo{ .buffer = *light_grid_buffer->buffer, .offset = 0, .range = vk::WholeSize },
+            vk::DescriptorBufferInfo{ .buffer = *light_index_buffer->buffer, .offset = 0, .range = vk::WholeSize },
+            vk::DescriptorBufferInfo{ .buffer = *cluster_stats_buffer->buffer, .offset = 0, .range = vk::WholeSize },
+        };
+
+        auto descriptor_writes = std::array<vk::WriteDescriptorSet, buffer_infos.size()>{};
+
+        for (u32 binding = 0; binding < descriptor_writes.size(); binding++)
+        {
+            descriptor_writes[binding] = vk::WriteDescriptorSet{
+                .dstSet = **descriptor_set,
+                .dstBinding = binding,
+                .descriptorCount = 1,
+                .descriptorType =
+                    binding == 0 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer,
+                .pBufferInfo = &buffer_infos[binding],
+            };
+        }
+
+        _device.updateDescriptorSets(descriptor_writes, {});
+
+        frame.uniform_buffer = std::move(*uniform_buffer);
+        frame.light_buffer = std::move(*light_buffer);
+        frame.light_grid_buffer = std::move(*light_grid_buffer);
+        frame.light_index_buffer = std::move(*light_index_buffer);
+        frame.cluster_stats_buffer = std::move(*cluster_stats_buffer);
+        frame.cluster_stats_readback_buffer = std::move(*cluster_stats_readback_buffer);
+        frame.descriptor_set = std::move(*descriptor_set);
+    }
+
+    return {};
+}
+
+auto VulkanRenderer::create_light_binning_pipeline() -> std::expected<void, std::string>
+{
+    auto compute_shader = create_shader_module(cluster_lights_compute_shader);
+
+    if (!compute_shader)
+        return std::unexpected{ compute_shader.error() };
+
+    const auto pipeline_layout_create_info = vk::PipelineLayoutCreateInfo{
+        .setLayoutCount = 1,
+        .pSetLayouts = &*_frame_descriptor_set_layout,
+    };
+
+    auto [create_pipeline_layout_result, pipeline_layout] = _device.createPipelineLayout(pipeline_layout_create_info);
+
+    if (create_pipeline_layout_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_pipeline_layout_result) };
+
+    _light_binning_pipeline_layout = std::move(pipeline_layout);
+
+    const auto pipeline_create_info = vk::ComputePipelineCreateInfo{
+        .stage = { .stage = vk::ShaderStageFlagBits::eCompute, .module = **compute_shader, .pName = "main" },
+        .layout = *_light_binning_pipeline_layout,
+    };
+
+    auto [create_pipeline_result, pipeline] = _device.createComputePipeline(nullptr, pipeline_create_info);
+
+    if (create_pipeline_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_pipeline_result) };
+
+    _light_binning_pipeline = std::move(pipeline);
+
+    return {};
+}
+
+auto VulkanRenderer::create_forward_pipeline() -> std::expected<void, std::string>
+{
+    auto vertex_shader = create_shader_module(forward_vertex_shader);
+
+    if (!vertex_shader)
+        return std::unexpected{ vertex_shader.error() };
+
+    auto fragment_shader = create_shader_module(forward_fragment_shader);
+
+    if (!fragment_shader)
+        return std::unexpected{ fragment_shader.error() };
+
+    const auto shader_stages = std::array{
+        vk::PipelineShaderStageCreateInfo{
+            .stage = vk::ShaderStageFlagBits::eVertex,
+            .module = **vertex_shader,
+            .pName = "main",
+        },
+        vk::PipelineShaderStageCreateInfo{
+            .stage = vk::ShaderStageFlagBits::eFragment,
+            .module = **fragment_shader,
+            .pName = "main",
+        },
+    };
+
+    const auto vertex_binding = vk::VertexInputBindingDescription{
+        .binding = 0,
+        .stride = sizeof(Vertex),
+        .inputRate = vk::VertexInputRate::eVertex,
+    };
+
+    const auto vertex_attributes = std::array{
+        vk::VertexInputAttributeDescription{ .location = 0,
+                                             .binding = 0,
+                                             .format = vk::Format::eR32G32B32Sfloat,
+                                             .offset = offsetof(Vertex, position) },
+        vk::VertexInputAttributeDescription{ .location = 1,
+                                             .binding = 0,
+                                             .format = vk::Format::eR32G32B32Sfloat,
+                                             .offset = offsetof(Vertex, normal) },
+        vk::VertexInputAttributeDescription{
+            .location = 2, .binding = 0, .format = vk::Format::eR32G32Sfloat, .offset = offsetof(Vertex, uv) },
+    };
+
+    const auto vertex_input_state = vk::PipelineVertexInputStateCreateInfo{
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &vertex_binding,
+        .vertexAttributeDescriptionCount = static_cast<u32>(vertex_attributes.size()),
+        .pVertexAttributeDescriptions = vertex_attributes.data(),
+    };
+
+    const auto input_assembly_state =
+        vk::PipelineInputAssemblyStateCreateInfo{ .topology = vk::PrimitiveTopology::eTriangleList };
+
+    // Viewport and scissor are dynamic, so the pipeline doesn't have to be recreated with the swapchain.
+    const auto viewport_state = vk::PipelineViewportStateCreateInfo{ .viewportCount = 1, .scissorCount = 1 };
+
+    const auto rasterization_state = vk::PipelineRasterizationStateCreateInfo{
+        .polygonMode = vk::PolygonMode::eFill,
+        .cullMode = vk::CullModeFlagBits::eBack,
+        .frontFace = vk::FrontFace::eCounterClockwise,
+        .lineWidth = 1.0f,
+    };
+
+    const auto multisample_state =
+        vk::PipelineMultisampleStateCreateInfo{ .rasterizationSamples = vk::SampleCountFlagBits::e1 };
+
+    const auto depth_stencil_state = vk::PipelineDepthStencilStateCreateInfo{
+        .depthTestEnable = true,
+        .depthWriteEnable = true,
+        .depthCompareOp = vk::CompareOp::eLess,
+    };
+
+    const auto color_blend_attachment = vk::PipelineColorBlendAttachmentState{
+        .blendEnable = false,
+        .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
+                          | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+    };
+
+    const auto color_blend_state = vk::PipelineColorBlendStateCreateInfo{
+        .attachmentCount = 1,
+        .pAttachments = &color_blend_attachment,
+    };
+
+    const auto dynamic_states = std::array{ vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+
+    const auto dynamic_state = vk::PipelineDynamicStateCreateInfo{
+        .dynamicStateCount = static_cast<u32>(dynamic_states.size()),
+        .pDynamicStates = dynamic_states.data(),
+    };
+
+    const auto color_format = render_target_format();
+
+    const auto rendering_create_info = vk::PipelineRenderingCreateInfo{
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &color_format,
+        .depthAttachmentFormat = depth_format,
+    };
+
+    const auto pipeline_create_info = vk::GraphicsPipelineCreateInfo{
+        .pNext = &rendering_create_info,
+        .stageCount = static_cast<u32>(shader_stages.size()),
+        .pStages = shader_stages.data(),
+        .pVertexInputState = &vertex_input_state,
+        .pInputAssemblyState = &input_assembly_state,
+        .pViewportState = &viewport_state,
+        .pRasterizationState = &rasterization_state,
+        .pMultisampleState = &multisample_state,
+        .pDepthStencilState = &depth_stencil_state,
+        .pColorBlendState = &color_blend_state,
+        .pDynamicState = &dynamic_state,
+        .layout = *_forward_pipeline_layout,
+    };
+
+    auto [create_pipeline_result, pipeline] = _device.createGraphicsPipeline(nullptr, pipeline_create_info);
+
+    if (create_pipeline_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_pipeline_result) };
+
+    _forward_pipeline = std::move(pipeline);
+
+    return {};
+}
+
+auto VulkanRenderer::create_shader_module(std::span<const u32> spirv) const
+    -> std::expected<vk::raii::ShaderModule, std::string>
+{
+    const auto shader_module_create_info = vk::ShaderModuleCreateInfo{
+        .codeSize = spirv.size_bytes(),
+        .pCode = spirv.data(),
+    };
+
+    auto [create_shader_module_result, shader_module] = _device.createShaderModule(shader_module_create_info);
+
+    if (create_shader_module_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_shader_module_result) };
+
+    return std::move(shader_module);
+}
+
+auto VulkanRenderer::allocate_descriptor_set(vk::DescriptorSetLayout layout)
+    -> std::expected<vk::raii::DescriptorSet, std::string>
+{
+    const auto descriptor_set_allocate_info = vk::DescriptorSetAllocateInfo{
+        .descriptorPool = *_descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout,
+    };
+
+    auto [allocate_descriptor_sets_result, descriptor_sets] =
+        _device.allocateDescriptorSets(descriptor_set_allocate_info);
+
+    if (allocate_descriptor_sets_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(allocate_descriptor_sets_result) };
+
+    return std::move(descriptor_sets.front());
+}
+
+auto VulkanRenderer::create_swapchain(vk::SwapchainKHR old_swapchain)
+    -> std::expected<std::optional<Swapchain>, std::string>
+{
+    auto [surface_capabilities_result, surface_capabilities] = _physical_device.getSurfaceCapabilitiesKHR(*_surface);
+
+    if (surface_capabilities_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(surface_capabilities_result) };
+
+    auto extent = surface_capabilities.currentExtent;
+
+    // A current extent of 0xFFFFFFFF means that the size of the surface is determined by the size of the swapchain.
+    if (extent.width == std::numeric_limits<u32>::max())
+    {
+        int width = 0;
+        int height = 0;
+        glfwGetFramebufferSize(_window, &width, &height);
+
+        extent.width = std::clamp(static_cast<u32>(width), surface_capabilities.minImageExtent.width,
+                                  surface_capabilities.maxImageExtent.width);
+        extent.height = std::clamp(static_cast<u32>(height), surface_capabilities.minImageExtent.height,
+                                   surface_capabilities.maxImageExtent.height);
+    }
+
+    // The window may have been minimized (or resized, on X11) since the framebuffer size was last checked, in which
+    // case the surface can report an empty extent. Creating a swapchain with it is invalid.
+    if (extent.width == 0 || extent.height == 0)
+        return std::nullopt;
+
+    // Transfer source usage is needed for frame readback.
+    const auto usage = vk::ImageUsageFlagBits::eColorAttachment
+                       | (surface_capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc);
+
+    auto min_image_count = surface_capabilities.minImageCount + 1;
+
+    if (surface_capabilities.maxImageCount > 0)
+        min_image_count = std::min(min_image_count, surface_capabilities.maxImageCount);
+
+    const auto swapchain_create_info = vk::SwapchainCreateInfoKHR{
+        .surface = *_surface,
+        .minImageCount = min_image_count,
+        .imageFormat = _surface_format.format,
+        .imageColorSpace = _surface_format.colorSpace,
+        .imageExtent = extent,
+        .imageArrayLayers = 1,
+        .imageUsage = usage,
+        .imageSharingMode = vk::SharingMode::eExclusive,
+        .preTransform = surface_capabilities.currentTransform,
+        .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
+        .presentMode = to_vk_present_mode(_present_mode),
+        .clipped = true,
+        .oldSwapchain = old_swapchain,
+    };
+
+    auto [create_swapchain_result, swapchain_handle] = _device.createSwapchainKHR(swapchain_create_info);
+
+    if (create_swapchain_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_swapchain_result) };
+
+    auto swapchain = Swapchain{ .swapchain = std::move(swapchain_handle), .extent = extent, .usage = usage };
+    swapchain.first_present_id = _present_id + 1;
+
+    auto [swapchain_images_result, swapchain_images] = swapchain.swapchain.getImages();
+
+    if (swapchain_images_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(swapchain_images_result) };
+
+    swapchain.images = std::move(swapchain_images);
+    swapchain.image_views.reserve(swapchain.images.size());
+    swapchain.render_finished_semaphores.reserve(swapchain.images.size());
+
+    for (auto& image : swapchain.images)
+    {
+        const auto image_view_create_info = vk::ImageViewCreateInfo{
+            .image = image,
+            .viewType = vk::ImageViewType::e2D,
+            .format = _surface_format.format,
+            .subresourceRange = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                                  .baseMipLevel = 0,
+                                  .levelCount = 1,
+                                  .baseArrayLayer = 0,
+                                  .layerCount = 1 },
+        };
+
+        auto [create_image_view_result, image_view] = _device.createImageView(image_view_create_info);
+
+        if (create_image_view_result != vk::Result::eSuccess)
+            return std::unexpected{ vk::to_string(create_image_view_result) };
+
+        swapchain.image_views.push_back(std::move(image_view));
+
+        auto [create_semaphore_result, render_finished_semaphore] = _device.createSemaphore(vk::SemaphoreCreateInfo{});
+
+        if (create_semaphore_result != vk::Result::eSuccess)
+            return std::unexpected{ vk::to_string(create_semaphore_result) };
+
+        swapchain.render_finished_semaphores.push_back(std::move(render_finished_semaphore));
+    }
+
+    auto depth_image = create_image(extent, depth_format, vk::ImageUsageFlagBits::eDepthStencilAttachment,
+                                    vk::ImageAspectFlagBits::eDepth);
+
+    if (!depth_image)
+        return std::unexpected{ depth_image.error() };
+
+    swapchain.depth_image = std::move(*depth_image);
+
+    return std::move(swapchain);
+}
+
+auto VulkanRenderer::recreate_swapchain() -> std::expected<bool, std::string>
+{
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(_window, &width, &height);
+
+    if (width == 0 || height == 0)
+        return false;
+
+    auto swapchain = create_swapchain(*_swapchain.swapchain);
+
+    if (!swapchain)
+        return std::unexpected{ swapchain.error() };
+
+    // Leaves the swapchain out of date, so that recreation is retried on the next frame.
+    if (!*swapchain)
+        return false;
+
+    // Instead of waiting for the device to go idle, the old swapchain is kept alive until the frames that could still
+    // reference it have retired. Presentation isn't tracked by the frame timeline, so we additionally wait for
+    // max_frames_in_flight frames on the new swapchain, which are presented on the same queue after the old ones.
+    if (*_swapchain.swapchain)
+        _deletion_queue.push(std::move(_swapchain), _frame_timeline_value + max_frames_in_flight);
+
+    _swapchain = std::move(**swapchain);
+    _swapchain_out_of_date = false;
+
+    RENDERER_INFO("Swapchain recreated ({}x{}).", _swapchain.extent.width, _swapchain.extent.height);
+
+    return true;
+}
+
+auto VulkanRenderer::completed_timeline_value() const -> std::expected<u64, std::string>
+{
+    auto [counter_value_result, counter_value] = _frame_timeline.getCounterValue();
+
+    if (counter_value_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(counter_value_result) };
+
+    return counter_value;
+}
+
+auto VulkanRenderer::set_deletion_time_budget(std::chrono::nanoseconds time_budget) -> void
+{
+    _deletion_time_budget = time_budget;
+}
+
+auto VulkanRenderer::pending_deletion_count() const -> usize
+{
+    return _deletion_queue.size();
+}
+
+auto VulkanRenderer::create_mesh(std::span<const MeshLod> lods) -> std::expected<MeshHandle, std::string>
+{
+    if (lods.empty())
+        return std::unexpected{ "A mesh needs at least one LOD." };
+
+    auto mesh = MeshResource{};
+    mesh.lods.reserve(lods.size());
+
+    for (auto& lod : lods)
+    {
+        if (lod.vertices.empty() || lod.indices.empty())
+            return std::unexpected{ "Mesh LODs can't be empty." };
+
+        if (std::ranges::any_of(lod.indices, [&lod](u32 index) { return index >= lod.vertices.size(); }))
+            return std::unexpected{ "Mesh LOD indices out of range." };
+
+        mesh.lods.push_back(MeshLodResource{
+            .vertices = { lod.vertices.begin(), lod.vertices.end() },
+            .indices = { lod.indices.begin(), lod.indices.end() },
+        });
+    }
+
+    const auto handle = MeshHandle{ insert_into_free_slot(_meshes, _free_mesh_slots, std::move(mesh)) };
+
+    if (_command_capture)
+        _command_capture->create_mesh(lods, handle);
+
+    return handle;
+}
+
+auto VulkanRenderer::destroy_mesh(MeshHandle mesh) -> void
+{
+    auto* mesh_resource = find_mesh(mesh);
+    RENDERER_ASSERT(mesh_resource);
+
+    if (!mesh_resource)
+        return;
+
+    if (_command_capture)
+        _command_capture->destroy_mesh(mesh);
+
+    for (auto& lod : mesh_resource->lods)
+    {
+        if (lod.gpu)
+            destroy_gpu_copy(lod);
+    }
+
+    _meshes[std::to_underlying(mesh)].reset();
+    _free_mesh_slots.push_back(std::to_underlying(mesh));
+}
+
+auto VulkanRenderer::create_texture(u32 width, u32 height, std::span<const std::byte> pixels)
+    -> std::expected<TextureHandle, std::string>
+{
+    if (width == 0 || height == 0)
+        return std::unexpected{ "Textures can't be empty." };
+
+    // Also keeps the byte count below from wrapping, since both dimensions are bounded by the device limit.
+    const auto max_dimension = _physical_device.getProperties().limits.maxImageDimension2D;
+
+    if (width > max_dimension || height > max_dimension)
+        return std::unexpected{ std::format("A {}x{} texture exceeds the maximum image dimension of {}.", width, height,
+                                            max_dimension) };
+
+    const auto size = usize{ width } * height * 4;
+
+    if (pixels.size() != size)
+        return std::unexpected{ std::format("Expected {} bytes of pixels for a {}x{} texture, got {}.", size, width,
+                                            height, pixels.size()) };
+
+    auto texture = TextureResource{
+        .extent = { .width = width, .height = height },
+        .pixels = { pixels.begin(), pixels.end() },
+    };
+
+    const auto handle = TextureHandle{ insert_into_free_slot(_textures, _free_texture_slots, std::move(texture)) };
+
+    if (_command_capture)
+        _command_capture->create_texture(width, height, pixels, handle);
+
+    return handle;
+}
+
+auto VulkanRenderer::destroy_texture(TextureHandle texture) -> void
+{
+    auto* texture_resource = find_texture(texture);
+    RENDERER_ASSERT(texture_resource);
+
+    if (!texture_resource)
+        return;
+
+    if (_command_capture)
+        _command_capture->destroy_texture(texture);
+
+    if (texture_resource->gpu)
+        destroy_gpu_copy(*texture_resource);
+
+    _textures[std::to_underlying(texture)].reset();
+    _free_texture_slots.push_back(std::to_underlying(texture));
+}
+
+auto VulkanRenderer::set_camera(const Camera& camera) -> void
+{
+    if (_command_capture)
+        _command_capture->set_camera(camera);
+
+    _camera = camera;
+}
+
+auto VulkanRenderer::submit_draw(MeshHandle mesh, u32 lod, const Mat4& transform, std::optional<TextureHandle> texture)
+    -> void
+{
+    RENDERER_ASSERT(find_mesh(mesh));
+    RENDERER_ASSERT(!texture || find_texture(*texture));
+
+    if (_command_capture)
+        _command_capture->submit_draw(mesh, lod, transform, texture);
+
+    _draws.push_back(Draw{ .mesh = mesh, .lod = lod, .transform = transform, .texture = texture });
+}
+
+auto VulkanRenderer::submit_light(const PointLight& light) -> void
+{
+    if (_command_capture)
+        _command_capture->submit_light(light);
+
+    _lights.push_back(light);
+}
+
+auto VulkanRenderer::cluster_stats() const -> ClusterStats
+{
+    return _cluster_stats;
+}
+
+auto VulkanRenderer::set_eviction_watermarks(f32 high_watermark, f32 low_watermark) -> void
+{
+    RENDERER_ASSERT(0.0f < low_watermark && low_watermark <= high_watermark && high_watermark <= 1.0f);
+
+    if (_command_capture)
+        _command_capture->set_eviction_watermarks(high_watermark, low_watermark);
+
+    _eviction_high_watermark = high_watermark;
+    _eviction_low_watermark = low_watermark;
+}
+
+auto VulkanRenderer::memory_stats() const -> MemoryStats
+{
+    auto stats = MemoryStats{
+        .budget_extension_enabled = _memory_budget_enabled,
+        .heaps = _memory_heaps,
+        .streamed_bytes = 0,
+        .memory_blocks = _memory_allocator->block_count(),
+        .resident_mesh_lods = 0,
+        .resident_textures = 0,
+        .uploads = _upload_count,
+        .evictions = _eviction_count,
+    };
+
+    for (auto streamed_bytes : _streamed_bytes)
+        stats.streamed_bytes += streamed_bytes;
+
+    for (auto& mesh : _meshes)
+    {
+        if (mesh)
+            stats.resident_mesh_lods += static_cast<usize>(std::ranges::count_if(
+                mesh->lods, [](const MeshLodResource& lod) { return lod.gpu.has_value(); }));
+    }
+
+    stats.resident_textures = static_cast<usize>(std::ranges::count_if(
+        _textures, [](const std::optional<TextureResource>& texture) { return texture && texture->gpu; }));
+
+    return stats;
+}
+
+auto VulkanRenderer::start_command_capture(const std::filesystem::path& path) -> std::expected<void, std::string>
+{
+    if (_command_capture)
+        return std::unexpected{ "A command capture is already running." };
+
+    const auto extent = _window ? _swapchain.extent : _offscreen_target.extent;
+
+    if (extent.width == 0 || extent.height == 0)
+        return std::unexpected{ "Can't capture commands while the render target is empty." };
+
+    auto writer = CommandStreamWriter::create(path, extent.width, extent.height);
+
+    if (!writer)
+        return std::unexpected{ writer.error() };
+
+    _command_capture = std::move(*writer);
+    RENDERER_INFO("Capturing commands to {} ({}x{}).", path.string(), extent.width, extent.height);
+
+    return {};
+}
+
+auto VulkanRenderer::stop_command_capture() -> std::expected<u64, std::string>
+{
+    if (!_command_capture)
+        return std::unexpected{ "No command capture is running." };
+
+    auto finish_result = _command_capture->finish();
+    const auto frame_count = _command_capture->frame_count();
+    const auto size = _command_capture->size();
+    _command_capture.reset();
+
+    if (!finish_result)
+        return std::unexpected{ finish_result.error() };
+
+    RENDERER_INFO("Captured {} frames of commands ({} bytes).", frame_count, size);
+
+    return frame_count;
+}
+
+auto VulkanRenderer::is_capturing_commands() const -> bool
+{
+    return _command_capture.has_value();
+}
+
+auto VulkanRenderer::wait_for_timeline_value(u64 timeline_value) const -> std::expected<void, std::string>
+{
+    const auto wait_info = vk::SemaphoreWaitInfo{
+        .semaphoreCount = 1,
+        .pSemaphores = &*_frame_timeline,
+        .pValues = &timeline_value,
+    };
+
+    if (auto wait_result = _device.waitSemaphores(wait_info, std::numeric_limits<u64>::max());
+        wait_result != vk::Result::eSuccess)
+    {
+        return std::unexpected{ vk::to_string(wait_result) };
+    }
+
+    return {};
+}
+
+auto VulkanRenderer::render_headless_frame() -> std::expected<void, std::string>
+{
+    auto& frame = _frames[_frame_index];
+
+    if (auto wait_result = wait_for_timeline_value(frame.timeline_value); !wait_result)
+        return std::unexpected{ wait_result.error() };
+
+    auto readback_slot = acquire_readback_slot(_offscreen_target.extent);
+
+    if (!readback_slot)
+        return std::unexpected{ readback_slot.error() };
+
+    if (auto prepare_frame_result = prepare_frame(frame, _offscreen_target.extent); !prepare_frame_result)
+        return std::unexpected{ prepare_frame_result.error() };
+
+    const auto render_target = RenderTarget{
+        .image = *_offscreen_target.image,
+        .image_view = *_offscreen_target.image_view,
+        .depth_image = *_offscreen_depth.image,
+        .depth_image_view = *_offscreen_depth.image_view,
+        .extent = _offscreen_target.extent,
+        .final_layout = std::nullopt,
+    };
+
+    auto record_frame_result = record_frame(frame, render_target, *readback_slot);
+
+    if (!record_frame_result)
+        return std::unexpected{ record_frame_result.error() };
+
+    return submit_frame(frame, nullptr, nullptr, *readback_slot);
+}
+
+auto VulkanRenderer::prepare_frame(Frame& frame, vk::Extent2D extent) -> std::expected<void, std::string>
+{
+    // We've waited for the previous frame recorded with this frame's resources to complete.
+    if (frame.timeline_value > 0)
+    {
+        if (auto read_stats_result = read_cluster_stats(frame); !read_stats_result)
+            return std::unexpected{ read_stats_result.error() };
+    }
+
+    frame.light_count = static_cast<u32>(std::min<usize>(_lights.size(), max_lights));
+
+    for (u32 i = 0; i < frame.light_count; i++)
+    {
+        const auto& light = _lights[i];
+        const auto gpu_light = GpuPointLight{
+            .position_radius = { light.position[0], light.position[1], light.position[2], light.radius },
+            .color_intensity = { light.color[0], light.color[1], light.color[2], light.intensity },
+        };
+
+        std::memcpy(frame.light_buffer.mapped + sizeof(GpuPointLight) * i, &gpu_light, sizeof(gpu_light));
+    }
+
+    // The clusters cover the depth range of the camera, which is derived from a perspective projection like the one
+    // built by math::perspective().
+    const auto& projection = _camera.projection;
+    auto near_plane = projection[14] / projection[10];
+    auto far_plane = projection[14] / (projection[10] + 1.0f);
+
+    if (!(near_plane > 0.0f && far_plane > near_plane && std::isfinite(far_plane)))
+    {
+        near_plane = fallback_cluster_near_plane;
+        far_plane = fallback_cluster_far_plane;
+    }
+
+    const auto tile_width = (extent.width + cluster_grid.x - 1) / cluster_grid.x;
+    const auto tile_height = (extent.height + cluster_grid.y - 1) / cluster_grid.y;
+
+    const auto uniforms = FrameUniforms{
+        .view = _camera.view,
+        .projection = _camera.projection,
+        .cluster_grid = { cluster_grid.x, cluster_grid.y, cluster_grid.z, frame.light_count },
+        .cluster_depth = { near_plane, far_plane, std::log(far_plane / near_plane), 0.0f },
+        .cluster_tile = { static_cast<f32>(tile_width), static_cast<f32>(tile_height),
+                          1.0f / static_cast<f32>(extent.width), 1.0f / static_cast<f32>(extent.height) },
+    };
+
+    std::memcpy(frame.uniform_buffer.mapped, &uniforms, sizeof(uniforms));
+
+    // Everything drawn this frame is marked as used before anything gets streamed in, so that streaming in one of the
+    // resources can't evict another one we're about to draw.
+    for (auto& draw : _draws)
+    {
+        if (auto* mesh = find_mesh(draw.mesh))
+        {
+            draw.lod = std::min(draw.lod, static_cast<u32>(mesh->lods.size() - 1));
+            mesh->lods[draw.lod].residency.last_used_frame = _frame_number;
+        }
+
+        if (auto* texture = draw.texture ? find_texture(*draw.texture) : nullptr)
+            texture->residency.last_used_frame = _frame_number;
+    }
+
+    // The previous frame's candidates may point at resources that have been destroyed since.
+    _eviction_candidates_heap_index.reset();
+    enforce_memory_budget();
+
+    _resolved_draws.clear();
+
+    for (auto& draw : _draws)
+    {
+        auto* mesh = find_mesh(draw.mesh);
+
+        if (!mesh)
+            continue;
+
+        const auto* lod = resident_mesh_lod(*mesh, draw.lod);
+
+        if (!lod)
+            continue;
+
+        auto texture_descriptor_set = *_default_texture.descriptor_set;
+
+        if (auto* texture = draw.texture ? find_texture(*draw.texture) : nullptr; texture && make_resident(*texture))
+            texture_descriptor_set = *texture->gpu->descriptor_set;
+
+        _resolved_draws.push_back(ResolvedDraw{
+            .vertex_buffer = *lod->gpu->vertex_buffer.buffer,
+            .index_buffer = *lod->gpu->index_buffer.buffer,
+            .index_count = static_cast<u32>(lod->indices.size()),
+            .texture_descriptor_set = texture_descriptor_set,
+            .transform = draw.transform,
+        });
+    }
+
+    return {};
+}
+
+auto VulkanRenderer::read_cluster_stats(const Frame& frame) -> std::expected<void, std::string>
+{
+    const auto& buffer = frame.cluster_stats_readback_buffer;
+
+    if (auto invalidate_result = _memory_allocator->invalidate(_device, buffer.allocation); !invalidate_result)
+        return std::unexpected{ invalidate_result.error() };
+
+    auto stats = GpuClusterStats{};
+    std::memcpy(&stats, buffer.mapped, sizeof(stats));
+
+    const auto average_lights = stats.occupied_cluster_count > 0 ? static_cast<f32>(stats.light_index_count)
+                                                                       / static_cast<f32>(stats.occupied_cluster_count)
+                                                                 : 0.0f;
+
+    _cluster_stats = ClusterStats{
+        .grid = cluster_grid,
+        .light_count = frame.light_count,
+        .occupied_clusters = stats.occupied_cluster_count,
+        .max_cluster_lights = stats.max_cluster_light_count,
+        .average_lights_per_occupied_cluster = average_lights,
+        .light_references = stats.light_index_count,
+        .overflowed_clusters = stats.overflowed_cluster_count,
+        .histogram = stats.histogram,
+    };
+
+    return {};
+}
+
+auto VulkanRenderer::record_frame(const Frame& frame, const RenderTarget& render_target,
+                                  const ReadbackSlot* readback_slot) -> std::expected<void, std::string>
+{
+    const auto& command_buffer = frame.command_buffer;
+
+    // The command pool is created with eResetCommandBuffer, so beginning the command buffer implicitly resets it.
+    const auto begin_info = vk::CommandBufferBeginInfo{ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit };
+
+    if (auto begin_result = command_buffer.begin(begin_info); begin_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(begin_result) };
+
+    record_uploads(command_buffer);
+    record_dynamic_buffer_copies(frame);
+    record_light_binning(frame);
+
+    // The offscreen target is shared between frames in flight, so we also have to wait for the readback copy of the
+    // previous frame before overwriting it. Swapchain images are protected by the acquire semaphore instead.
+    const auto previous_use_stages =
+        _window ? vk::PipelineStageFlags2{ vk::PipelineStageFlagBits2::eColorAttachmentOutput }
+                : vk::PipelineStageFlagBits2::eColorAttachmentOutput | vk::PipelineStageFlagBits2::eCopy;
+
+    const auto to_color_attachment_barrier = image_layout_barrier(
+        render_target.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal,
+        previous_use_stages, vk::AccessFlagBits2::eNone, vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+        vk::AccessFlagBits2::eColorAttachmentWrite);
+
+    // The depth image is shared between frames in flight as well.
+    const auto depth_stages =
+        vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests;
+
+    const auto to_depth_attachment_barrier = image_layout_barrier(
+        render_target.depth_image, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthAttachmentOptimal, depth_stages,
+        vk::AccessFlagBits2::eDepthStencilAttachmentWrite, depth_stages,
+        vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+        vk::ImageAspectFlagBits::eDepth);
+
+    const auto attachment_barriers = std::array{ to_color_attachment_barrier, to_depth_attachment_barrier };
+
+    command_buffer.pipelineBarrier2(vk::DependencyInfo{
+        .imageMemoryBarrierCount = static_cast<u32>(attachment_barriers.size()),
+        .pImageMemoryBarriers = attachment_barriers.data(),
+    });
+
+    const auto color_attachment = vk::RenderingAttachmentInfo{
+        .imageView = render_target.image_view,
+        .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+        .loadOp = vk::AttachmentLoadOp::eClear,
+        .storeOp = vk::AttachmentStoreOp::eStore,
+        .clearValue = { .color = { .float32 = std::array{ 0.01f, 0.01f, 0.01f, 1.0f } } },
+    };
+
+    const auto depth_attachment = vk::RenderingAttachmentInfo{
+        .imageView = render_target.depth_image_view,
+        .imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
+        .loadOp = vk::AttachmentLoadOp::eClear,
+        .storeOp = vk::AttachmentStoreOp::eDontCare,
+        .clearValue = { .depthStencil = { .depth = 1.0f, .stencil = 0 } },
+    };
+
+    const auto rendering_info = vk::RenderingInfo{
+        .renderArea = { .offset = { 0, 0 }, .extent = render_target.extent },
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &color_attachment,
+        .pDepthAttachment = &depth_attachment,
+    };
+
+    command_buffer.beginRendering(rendering_info);
+    record_draws(frame, render_target.extent);
+    command_buffer.endRendering();
+
+    auto layout = vk::ImageLayout::eColorAttachmentOptimal;
+    auto last_stage = vk::PipelineStageFlags2{ vk::PipelineStageFlagBits2::eColorAttachmentOutput };
+    auto last_access = vk::AccessFlags2{ vk::AccessFlagBits2::eColorAttachmentWrite };
+
+    if (readback_slot)
+    {
+        const auto to_transfer_src_barrier = image_layout_barrier(
+            render_target.image, layout, vk::ImageLayout::eTransferSrcOptimal, last_stage, last_access,
+            vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead);
+
+        command_buffer.pipelineBarrier2(
+            vk::DependencyInfo{ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &to_transfer_src_barrier });
+
+        const auto copy_region = vk::BufferImageCopy{
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                                  .mipLevel = 0,
+                                  .baseArrayLayer = 0,
+                                  .layerCount = 1 },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { render_target.extent.width, render_target.extent.height, 1 },
+        };
+
+        command_buffer.copyImageToBuffer(render_target.image, vk::ImageLayout::eTransferSrcOptimal,
+                                         *readback_slot->buffer.buffer, copy_region);
+
+        const auto to_host_barrier = vk::BufferMemoryBarrier2{
+            .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+            .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+            .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+            .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+            .buffer = *readback_slot->buffer.buffer,
+            .offset = 0,
+            .size = vk::WholeSize,
+        };
+
+        command_buffer.pipelineBarrier2(
+            vk::DependencyInfo{ .bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &to_host_barrier });
+
+        layout = vk::ImageLayout::eTransferSrcOptimal;
+        last_stage = vk::PipelineStageFlagBits2::eCopy;
+        last_access = vk::AccessFlagBits2::eNone;
+    }
+
+    if (render_target.final_layout && *render_target.final_layout != layout)
+    {
+        const auto to_final_layout_barrier =
+            image_layout_barrier(render_target.image, layout, *render_target.final_layout, last_stage, last_access,
+                                 vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eNone);
+
+        command_buffer.pipelineBarrier2(
+            vk::DependencyInfo{ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &to_final_layout_barrier });
+    }
+
+    if (auto end_result = command_buffer.end(); end_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(end_result) };
+
+    return {};
+}
+
+auto VulkanRenderer::record_uploads(const vk::raii::CommandBuffer& command_buffer) const -> void
+{
+    if (_buffer_uploads.empty() && _image_uploads.empty())
+        return;
+
+    auto to_transfer_dst_barriers = std::vector<vk::ImageMemoryBarrier2>{};
+    auto to_shader_read_barriers = std::vector<vk::ImageMemoryBarrier2>{};
+
+    for (auto& upload : _image_uploads)
+    {
+        to_transfer_dst_barriers.push_back(image_layout_barrier(
+            upload.destination, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+            vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, vk::PipelineStageFlagBits2::eCopy,
+            vk::AccessFlagBits2::eTransferWrite));
+
+        to_shader_read_barriers.push_back(image_layout_barrier(
+            upload.destination, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+            vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferWrite,
+            vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderSampledRead));
+    }
+
+    command_buffer.pipelineBarrier2(vk::DependencyInfo{
+        .imageMemoryBarrierCount = static_cast<u32>(to_transfer_dst_barriers.size()),
+        .pImageMemoryBarriers = to_transfer_dst_barriers.data(),
+    });
+
+    for (auto& upload : _image_uploads)
+    {
+        const auto copy_region = vk::BufferImageCopy{
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+                                  .mipLevel = 0,
+                                  .baseArrayLayer = 0,
+                                  .layerCount = 1 },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { upload.extent.width, upload.extent.height, 1 },
+        };
+
+        command_buffer.copyBufferToImage(*upload.staging_buffer.buffer, upload.destination,
+                                         vk::ImageLayout::eTransferDstOptimal, copy_region);
+    }
+
+    for (auto& upload : _buffer_uploads)
+    {
+        command_buffer.copyBuffer(*upload.staging_buffer.buffer, upload.destination,
+                                  vk::BufferCopy{ .srcOffset = 0, .dstOffset = 0, .size = upload.staging_buffer.size });
+    }
+
+    const auto vertex_input_barrier = vk::MemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eVertexAttributeInput | vk::PipelineStageFlagBits2::eIndexInput,
+        .dstAccessMask = vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eIndexRead,
+    };
+
+    command_buffer.pipelineBarrier2(vk::DependencyInfo{
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &vertex_input_barrier,
+        .imageMemoryBarrierCount = static_cast<u32>(to_shader_read_barriers.size()),
+        .pImageMemoryBarriers = to_shader_read_barriers.data(),
+    });
+}
+
+auto VulkanRenderer::record_dynamic_buffer_copies(const Frame& frame) const -> void
+{
+    const auto& command_buffer = frame.command_buffer;
+    auto copied = false;
+
+    if (auto& uniform_buffer = frame.uniform_buffer; *uniform_buffer.staging_buffer.buffer)
+    {
+        command_buffer.copyBuffer(*uniform_buffer.staging_buffer.buffer, *uniform_buffer.buffer.buffer,
+                                  vk::BufferCopy{ .srcOffset = 0, .dstOffset = 0, .size = sizeof(FrameUniforms) });
+        copied = true;
+    }
+
+    // Only the lights written this frame.
+    if (auto& light_buffer = frame.light_buffer; *light_buffer.staging_buffer.buffer && frame.light_count > 0)
+    {
+        command_buffer.copyBuffer(
+            *light_buffer.staging_buffer.buffer, *light_buffer.buffer.buffer,
+            vk::BufferCopy{ .srcOffset = 0, .dstOffset = 0, .size = sizeof(GpuPointLight) * frame.light_count });
+        copied = true;
+    }
+
+    if (!copied)
+        return;
+
+    const auto shader_read_barrier = vk::MemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eVertexShader
+                        | vk::PipelineStageFlagBits2::eFragmentShader,
+        .dstAccessMask = vk::AccessFlagBits2::eUniformRead | vk::AccessFlagBits2::eShaderStorageRead,
+    };
+
+    command_buffer.pipelineBarrier2(
+        vk::DependencyInfo{ .memoryBarrierCount = 1, .pMemoryBarriers = &shader_read_barrier });
+}
+
+auto VulkanRenderer::record_light_binning(const Frame& frame) const -> void
+{
+    const auto& command_buffer = frame.command_buffer;
+
+    // The light count doubles as the allocator for the light index list, so it has to start at zero.
+    command_buffer.fillBuffer(*frame.cluster_stats_buffer.buffer, 0, vk::WholeSize, 0);
+
+    const auto clear_barrier = vk::MemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eClear,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    };
+
+    command_buffer.pipelineBarrier2(vk::DependencyInfo{ .memoryBarrierCount = 1, .pMemoryBarriers = &clear_barrier });
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *_light_binning_pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *_light_binning_pipeline_layout, 0,
+                                      *frame.descriptor_set, {});
+    command_buffer.dispatch((cluster_count + light_binning_workgroup_size - 1) / light_binning_workgroup_size, 1, 1);
+
+    const auto binning_barriers = std::array{
+        // Light grid and index list, read by the forward pass.
+        vk::MemoryBarrier2{
+            .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+            .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+            .dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader,
+            .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+        },
+        // Stats, copied to the readback buffer.
+        vk::MemoryBarrier2{
+            .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+            .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+            .dstStageMask = vk::PipelineStageFlagBits2::eCopy,
+            .dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+        },
+    };
+
+    command_buffer.pipelineBarrier2(vk::DependencyInfo{
+        .memoryBarrierCount = static_cast<u32>(binning_barriers.size()),
+        .pMemoryBarriers = binning_barriers.data(),
+    });
+
+    command_buffer.copyBuffer(*frame.cluster_stats_buffer.buffer, *frame.cluster_stats_readback_buffer.buffer,
+                              vk::BufferCopy{ .srcOffset = 0, .dstOffset = 0, .size = sizeof(GpuClusterStats) });
+
+    // Read by the CPU once the frame has completed.
+    const auto readback_barrier = vk::MemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+        .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+    };
+
+    command_buffer.pipelineBarrier2(
+        vk::DependencyInfo{ .memoryBarrierCount = 1, .pMemoryBarriers = &readback_barrier });
+}
+
+auto VulkanRenderer::record_draws(const Frame& frame, vk::Extent2D extent) const -> void
+{
+    const auto& command_buffer = frame.command_buffer;
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *_forward_pipeline);
+
+    command_buffer.setViewport(0, vk::Viewport{
+                                      .x = 0.0f,
+                                      .y = 0.0f,
+                                      .width = static_cast<f32>(extent.width),
+                                      .height = static_cast<f32>(extent.height),
+                                      .minDepth = 0.0f,
+                                      .maxDepth = 1.0f,
+                                  });
+
+    command_buffer.setScissor(0, vk::Rect2D{ .offset = { 0, 0 }, .extent = extent });
+
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *_forward_pipeline_layout, 0,
+                                      *frame.descriptor_set, {});
+
+    for (auto& draw : _resolved_draws)
+    {
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *_forward_pipeline_layout, 1,
+                                          draw.texture_descriptor_set, {});
+        command_buffer.pushConstants<Mat4>(*_forward_pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0,
+                                           draw.transform);
+        command_buffer.bindVertexBuffers(0, draw.vertex_buffer, vk::DeviceSize{ 0 });
+        command_buffer.bindIndexBuffer(draw.index_buffer, 0, vk::IndexType::eUint32);
+        command_buffer.drawIndexed(draw.index_count, 1, 0, 0, 0);
+    }
+}
+
+auto VulkanRenderer::submit_frame(Frame& frame, vk::Semaphore wait_semaphore, vk::Semaphore signal_semaphore,
+                                  ReadbackSlot* readback_slot) -> std::expected<void, std::string>
+{
+    const auto wait_semaphore_info = vk::SemaphoreSubmitInfo{
+        .semaphore = wait_semaphore,
+        .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+    };
+
+    const auto signal_semaphore_infos = std::array{
+        vk::SemaphoreSubmitInfo{
+            .semaphore = *_frame_timeline,
+            .value = _frame_timeline_value + 1,
+            .stageMask = vk::PipelineStageFlagBits2::eAllCommands,
+        },
+        vk::SemaphoreSubmitInfo{
+            .semaphore = signal_semaphore,
+            .stageMask = vk::PipelineStageFlagBits2::eAllCommands,
+        },
+    };
+
+    const auto command_buffer_submit_info = vk::CommandBufferSubmitInfo{ .commandBuffer = *frame.command_buffer };
+
+    const auto submit_info = vk::SubmitInfo2{
+        .waitSemaphoreInfoCount = wait_semaphore ? 1u : 0u,
+        .pWaitSemaphoreInfos = &wait_semaphore_info,
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &command_buffer_submit_info,
+        .signalSemaphoreInfoCount = signal_semaphore ? 2u : 1u,
+        .pSignalSemaphoreInfos = signal_semaphore_infos.data(),
+    };
+
+    if (auto submit_result = _graphics_queue.submit2(submit_info); submit_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(submit_result) };
+
+    frame.timeline_value = ++_frame_timeline_value;
+    _frame_index = (_frame_index + 1) % max_frames_in_flight;
+
+    // Staging buffers can go as soon as the frame that copies from them has completed.
+    for (auto& upload : _buffer_uploads)
+        destroy_deferred(std::move(upload.staging_buffer));
+
+    for (auto& upload : _image_uploads)
+        destroy_deferred(std::move(upload.staging_buffer));
+
+    _buffer_uploads.clear();
+    _image_uploads.clear();
+
+    if (readback_slot)
+    {
+        readback_slot->frame_number = _frame_number;
+        readback_slot->timeline_value = _frame_timeline_value;
+        readback_slot->pending = true;
+        _readback_slot_index = (_readback_slot_index + 1) % static_cast<u32>(_readback_slots.size());
+    }
+
+    _frame_number++;
+
+    return {};
+}
+
+auto VulkanRenderer::render_target_format() const -> vk::Format
+{
+    return _window ? _surface_format.format : offscreen_target_format;
+}
+
+auto VulkanRenderer::readback_pixel_format() const -> std::optional<PixelFormat>
+{
+    switch (render_target_format())
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+        return PixelFormat::Rgba8;
+    case vk::Format::eB8G8R8A8Unorm:
+    case vk::Format::eB8G8R8A8Srgb:
+        return PixelFormat::Bgra8;
+    default:
+        return std::nullopt;
+    }
+}
+
+auto VulkanRenderer::acquire_readback_slot(vk::Extent2D extent) -> std::expected<ReadbackSlot*, std::string>
+{
+    if (_readback_slots.empty())
+        return nullptr;
+
+    auto& slot = _readback_slots[_readback_slot_index];
+
+    // The slot still holds the oldest frame in the ring. This only blocks if the ring is too small to cover the frames
+    // in flight.
+    if (slot.pending)
+    {
+        if (auto wait_result = wait_for_timeline_value(slot.timeline_value); !wait_result)
+            return std::unexpected{ wait_result.error() };
+
+        if (auto deliver_result = deliver_readback(slot); !deliver_result)
+            return std::unexpected{ deliver_result.error() };
+    }
+
+    const auto required_size = vk::DeviceSize{ extent.width } * extent.height * 4;
+
+    if (!*slot.buffer.buffer || slot.buffer.size < required_size)
+    {
+        auto buffer = create_buffer(required_size, vk::BufferUsageFlagBits::eTransferDst, MemoryUsage::Readback);
+
+        if (!buffer)
+            return std::unexpected{ buffer.error() };
+
+        destroy_deferred(std::exchange(slot.buffer, std::move(*buffer)));
+    }
+
+    slot.extent = extent;
+    slot.format = *readback_pixel_format();
+
+    return &slot;
+}
+
+auto VulkanRenderer::deliver_completed_readbacks(u64 completed_timeline_value) -> std::expected<void, std::string>
+{
+    // Starting from the next slot to be written, the ring is ordered from the oldest to the newest frame.
+    for (u32 i = 0; i < _readback_slots.size(); i++)
+    {
+        auto& slot = _readback_slots[(_readback_slot_index + i) % _readback_slots.size()];
+
+        if (!slot.pending)
+            continue;
+
+        if (slot.timeline_value > completed_timeline_value)
+            break;
+
+        if (auto deliver_result = deliver_readback(slot); !deliver_result)
+            return std::unexpected{ deliver_result.error() };
+    }
+
+    return {};
+}
+
+auto VulkanRenderer::deliver_readback(ReadbackSlot& slot) -> std::expected<void, std::string>
+{
+    RENDERER_ASSERT(slot.pending);
+    slot.pending = false;
+
+    const auto size = vk::DeviceSize{ slot.extent.width } * slot.extent.height * 4;
+
+    if (auto invalidate_result = _memory_allocator->invalidate(_device, slot.buffer.allocation); !invalidate_result)
+        return std::unexpected{ invalidate_result.error() };
+
+    _readback_callback(ReadbackFrame{
+        .frame_number = slot.frame_number,
+        .width = slot.extent.width,
+        .height = slot.extent.height,
+        .format = slot.format,
+        .pixels = std::span{ slot.buffer.mapped, static_cast<usize>(size) },
+    });
+
+    return {};
+}
+
+auto VulkanRenderer::find_mesh(MeshHandle mesh) -> MeshResource*
+{
+    const auto index = std::to_underlying(mesh);
+
+    if (index >= _meshes.size() || !_meshes[index])
+        return nullptr;
+
+    return &*_meshes[index];
+}
+
+auto VulkanRenderer::find_texture(TextureHandle texture) -> TextureResource*
+{
+    const auto index = std::to_underlying(texture);
+
+    if (index >= _textures.size() || !_textures[index])
+        return nullptr;
+
+    return &*_textures[index];
+}
+
+auto VulkanRenderer::resident_mesh_lod(MeshResource& mesh, u32 lod) -> const MeshLodResource*
+{
+    if (make_resident(mesh.lods[lod]))
+        return &mesh.lods[lod];
+
+    // At the same distance, the more detailed LOD wins.
+    for (u32 distance = 1; distance < mesh.lods.size(); distance++)
+    {
+        for (auto fallback : { lod - distance, lod + distance })
+        {
+            // lod - distance wraps around past zero, which the bounds check catches as well.
+            if (fallback >= mesh.lods.size() || !mesh.lods[fallback].gpu)
+                continue;
+
+            mesh.lods[fallback].residency.last_used_frame = _frame_number;
+            return &mesh.lods[fallback];
+        }
+    }
+
+    return nullptr;
+}
+
+auto VulkanRenderer::make_resident(MeshLodResource& lod) -> bool
+{
+    lod.residency.last_used_frame = _frame_number;
+
+    if (lod.gpu)
+        return true;
+
+    const auto size = std::span{ lod.vertices }.size_bytes() + std::span{ lod.indices }.size_bytes();
+    auto gpu = create_streamed(size, false, [this, &lod] { return create_gpu_mesh_lod(lod.vertices, lod.indices); });
+
+    if (!gpu)
+    {
+        RENDERER_WARNING("Failed to stream in a mesh LOD: {}", gpu.error());
+        return false;
+    }
+
+    track_streamed_allocation(lod.residency, gpu->vertex_buffer.allocation.heap_index(),
+                              gpu->vertex_buffer.allocation.size() + gpu->index_buffer.allocation.size());
+    lod.gpu = std::move(*gpu);
+
+    return true;
+}
+
+auto VulkanRenderer::make_resident(TextureResource& texture) -> bool
+{
+    texture.residency.last_used_frame = _frame_number;
+
+    if (texture.gpu)
+        return true;
+
+    auto gpu = create_streamed(texture.pixels.size(), true,
+                               [this, &texture] { return create_gpu_texture(texture.extent, texture.pixels); });
+
+    if (!gpu)
+    {
+        RENDERER_WARNING("Failed to stream in a texture: {}", gpu.error());
+        return false;
+    }
+
+    track_streamed_allocation(texture.residency, gpu->image.allocation.heap_index(), gpu->image.allocation.size());
+    texture.gpu = std::move(*gpu);
+
+    return true;
+}
+
+auto VulkanRenderer::create_gpu_mesh_lod(std::span<const Vertex> vertices, std::span<const u32> indices)
+    -> std::expected<GpuMeshLod, std::string>
+{
+    auto vertex_buffer = create_buffer(vertices.size_bytes(),
+                                       vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                       MemoryUsage::GpuOnly);
+
+    if (!vertex_buffer)
+        return std::unexpected{ vertex_buffer.error() };
+
+    auto index_buffer = create_buffer(indices.size_bytes(),
+                                      vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                      MemoryUsage::GpuOnly);
+
+    if (!index_buffer)
+        return std::unexpected{ index_buffer.error() };
+
+    auto vertex_staging_buffer = create_staging_buffer(std::as_bytes(vertices));
+
+    if (!vertex_staging_buffer)
+        return std::unexpected{ vertex_staging_buffer.error() };
+
+    auto index_staging_buffer = create_staging_buffer(std::as_bytes(indices));
+
+    if (!index_staging_buffer)
+        return std::unexpected{ index_staging_buffer.error() };
+
+    _buffer_uploads.push_back(
+        BufferUpload{ .staging_buffer = std::move(*vertex_staging_buffer), .destination = *vertex_buffer->buffer });
+    _buffer_uploads.push_back(
+        BufferUpload{ .staging_buffer = std::move(*index_staging_buffer), .destination = *index_buffer->buffer });
+
+    return GpuMeshLod{ .vertex_buffer = std::move(*vertex_buffer), .index_buffer = std::move(*index_buffer) };
+}
+
+auto VulkanRenderer::create_gpu_texture(vk::Extent2D extent, std::span<const std::byte> pixels)
+    -> std::expected<GpuTexture, std::string>
+{
+    auto image = create_image(extent, texture_format,
+                              vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+                              vk::ImageAspectFlagBits::eColor);
+
+    if (!image)
+        return std::unexpected{ image.error() };
+
+    auto staging_buffer = create_staging_buffer(pixels);
+
+    if (!staging_buffer)
+        return std::unexpected{ staging_buffer.error() };
+
+    auto descriptor_set = allocate_descriptor_set(*_texture_descriptor_set_layout);
+
+    if (!descriptor_set)
+        return std::unexpected{ descriptor_set.error() };
+
+    const auto image_info = vk::DescriptorImageInfo{
+        .sampler = *_texture_sampler,
+        .imageView = *image->image_view,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    };
+
+    _device.updateDescriptorSets(vk::WriteDescriptorSet{ .dstSet = **descriptor_set,
+                                                         .dstBinding = 0,
+                                                         .descriptorCount = 1,
+                                                         .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+                                                         .pImageInfo = &image_info },
+                                 {});
+
+    _image_uploads.push_back(ImageUpload{
+        .staging_buffer = std::move(*staging_buffer),
+        .destination = *image->image,
+        .extent = extent,
+    });
+
+    return GpuTexture{ .image = std::move(*image), .descriptor_set = std::move(*descriptor_set) };
+}
+
+auto VulkanRenderer::create_staging_buffer(std::span<const std::byte> data) -> std::expected<Buffer, std::string>
+{
+    // Upload memory is host-coherent, so no flush is needed.
+    auto buffer = create_buffer(data.size(), vk::BufferUsageFlagBits::eTransferSrc, MemoryUsage::Upload);
+
+    if (!buffer)
+        return std::unexpected{ buffer.error() };
+
+    std::memcpy(buffer->mapped, data.data(), data.size());
+
+    return buffer;
+}
+
+template<typename CreateFunction>
+auto VulkanRenderer::create_streamed(vk::DeviceSize size, bool optimal_tiling, CreateFunction&& create)
+    -> std::invoke_result_t<CreateFunction>
+{
+    const auto heap_index = _streaming_heap_index;
+    // Resources that fit into the free space of a block don't add to the heap usage.
+    const auto expected_usage =
+        heap_usage_estimate(heap_index)
+        + _memory_allocator->expected_growth(_streaming_memory_type_index, optimal_tiling, size);
+
+    if (expected_usage > heap_watermark(heap_index, _eviction_high_watermark))
+        evict_streamed_resources(heap_index, expected_usage - heap_watermark(heap_index, _eviction_low_watermark));
+
+    auto result = create();
+
+    // The budget is only an estimate, so allocations can still fail. Evicted memory is only freed once the GPU is done
+    // with it, so instead of retrying right away we make room for the resource to be streamed in on a later frame.
+    if (!result)
+        evict_streamed_resources(heap_index, size);
+
+    return result;
+}
+
+auto VulkanRenderer::track_streamed_allocation(Residency& residency, u32 heap_index, vk::DeviceSize size) -> void
+{
+    residency.heap_index = heap_index;
+    residency.size = size;
+
+    _streamed_bytes[heap_index] += size;
+    _upload_count++;
+}
+
+auto VulkanRenderer::release_streamed_allocation(Residency& residency) -> void
+{
+    const auto heap_index = residency.heap_index;
+
+    _streamed_bytes[heap_index] -= residency.size;
+
+    residency.size = 0;
+}
+
+auto VulkanRenderer::destroy_gpu_copy(MeshLodResource& lod) -> void
+{
+    _memory_allocator->retire(lod.gpu->vertex_buffer.allocation);
+    _memory_allocator->retire(lod.gpu->index_buffer.allocation);
+    release_streamed_allocation(lod.residency);
+    destroy_deferred(std::move(*lod.gpu));
+    lod.gpu.reset();
+}
+
+auto VulkanRenderer::destroy_gpu_copy(TextureResource& texture) -> void
+{
+    _memory_allocator->retire(texture.gpu->image.allocation);
+    release_streamed_allocation(texture.residency);
+    destroy_deferred(std::move(*texture.gpu));
+    texture.gpu.reset();
+}
+
+auto VulkanRenderer::evict(MeshLodResource& lod) -> void
+{
+    destroy_gpu_copy(lod);
+    _eviction_count++;
+}
+
+auto VulkanRenderer::evict(TextureResource& texture) -> void
+{
+    destroy_gpu_copy(texture);
+    _eviction_count++;
+}
+
+auto VulkanRenderer::collect_eviction_candidates(u32 heap_index) -> void
+{
+    // Resources used in the current frame are never evicted.
+    auto is_candidate = [this, heap_index](const Residency& residency) {
+        return residency.heap_index == heap_index && residency.last_used_frame < _frame_number;
+    };
+
+    auto& candidates = _eviction_candidates;
+    candidates.clear();
+
+    for (auto& mesh : _meshes)
+    {
+        if (!mesh)
+            continue;
+
+        for (auto& lod : mesh->lods)
+        {
+            if (lod.gpu && is_candidate(lod.residency))
+                candidates.push_back({ lod.residency.last_used_frame, lod.residency.size, &lod, nullptr });
+        }
+    }
+
+    for (auto& texture : _textures)
+    {
+        if (texture && texture->gpu && is_candidate(texture->residency))
+            candidates.push_back({ texture->residency.last_used_frame, texture->residency.size, nullptr, &*texture });
+    }
+
+    std::ranges::sort(candidates, {}, &EvictionCandidate::last_used_frame);
+
+    _next_eviction_candidate = 0;
+    _eviction_candidates_heap_index = heap_index;
+}
+
+auto VulkanRenderer::evict_streamed_resources(u32 heap_index, vk::DeviceSize bytes_to_free) -> vk::DeviceSize
+{
+    if (_eviction_candidates_heap_index != heap_index)
+        collect_eviction_candidates(heap_index);
+
+    auto freed_bytes = vk::DeviceSize{ 0 };
+
+    // Candidates before the next one have been evicted already, or were used after they were collected (e.g. drawn as
+    // a fallback LOD), in which case they stay resident for the rest of the frame.
+    while (freed_bytes < bytes_to_free && _next_eviction_candidate < _eviction_candidates.size())
+    {
+        const auto& candidate = _eviction_candidates[_next_eviction_candidate++];
+        const auto& residency = candidate.mesh_lod ? candidate.mesh_lod->residency : candidate.texture->residency;
+
+        if (residency.last_used_frame == _frame_number)
+            continue;
+
+        freed_bytes += candidate.size;
+
+        if (candidate.mesh_lod)
+            evict(*candidate.mesh_lod);
+        else
+            evict(*candidate.texture);
+    }
+
+    return freed_bytes;
+}
+
+auto VulkanRenderer::update_memory_budget() -> void
+{
+    auto memory_properties = vk::PhysicalDeviceMemoryProperties{};
+    auto budget_properties = vk::PhysicalDeviceMemoryBudgetPropertiesEXT{};
+
+    if (_memory_budget_enabled)
+    {
+        const auto properties = _physical_device.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2,
+                                                                      vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+
+        memory_properties = properties.get<vk::PhysicalDeviceMemoryProperties2>().memoryProperties;
+        budget_properties = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+    }
+    else
+    {
+        memory_properties = _physical_device.getMemoryProperties();
+    }
+
+    for (u32 i = 0; i < memory_properties.memoryHeapCount; i++)
+    {
+        const auto& heap = memory_properties.memoryHeaps[i];
+        auto& stats = _memory_heaps[i];
+
+        stats.size = heap.size;
+        stats.device_local = static_cast<bool>(heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+
+        _polled_reserved_bytes[i] = _memory_allocator->reserved_bytes(i);
+
+        // Without the extension, only our own memory blocks are accounted for.
+        if (!_memory_budget_enabled)
+        {
+            stats.budget = static_cast<vk::DeviceSize>(static_cast<f64>(heap.size) * fallback_budget_fraction);
+            stats.usage = _polled_reserved_bytes[i];
+            continue;
+        }
+
+        stats.budget = budget_properties.heapBudget[i];
+        stats.usage = budget_properties.heapUsage[i];
+    }
+}
+
+auto VulkanRenderer::heap_usage_estimate(u32 heap_index) const -> vk::DeviceSize
+{
+    // Blocks created or destroyed since the usage was polled aren't part of it yet. The unused parts of blocks are
+    // counted as used, since they're only released along with their whole block. Retired memory is discounted so that
+    // evicted resources waiting in the deletion queue aren't made up for by evicting even more of them.
+    const auto usage = _memory_heaps[heap_index].usage + _memory_allocator->reserved_bytes(heap_index);
+    const auto discounted_bytes = _polled_reserved_bytes[heap_index] + _memory_allocator->retired_bytes(heap_index);
+
+    return usage - std::min(usage, discounted_bytes);
+}
+
+auto VulkanRenderer::enforce_memory_budget() -> void
+{
+    for (u32 i = 0; i < _memory_heaps.size(); i++)
+    {
+        const auto usage = heap_usage_estimate(i);
+
+        // Evicted memory only lowers the polled usage once whole blocks are empty and destroyed. Until then, the
+        // estimate rises again when the deletion queue has destroyed it, and more is evicted on the following frames.
+        if (_streamed_bytes[i] == 0 || usage <= heap_watermark(i, _eviction_high_watermark))
+            continue;
+
+        const auto bytes_to_free = usage - heap_watermark(i, _eviction_low_watermark);
+        const auto freed_bytes = evict_streamed_resources(i, bytes_to_free);
+
+        if (freed_bytes < bytes_to_free)
+        {
+            RENDERER_WARNING("Memory heap {} is over budget, but only {} of {} bytes could be evicted.", i, freed_bytes,
+                             bytes_to_free);
+        }
+    }
+}
+
+auto VulkanRenderer::heap_watermark(u32 heap_index, f32 watermark) const -> vk::DeviceSize
+{
+    return static_cast<vk::DeviceSize>(static_cast<f64>(_memory_heaps[heap_index].budget) * watermark);
+}
+
+auto VulkanRenderer::find_memory_type(u32 type_bits, vk::MemoryPropertyFlags required,
+                                      vk::MemoryPropertyFlags preferred) const -> std::optional<u32>
+{
+    const auto memory_properties = _physical_device.getMemoryProperties();
+    auto fallback = std::optional<u32>{ std::nullopt };
+
+    for (u32 i = 0; i < memory_properties.memoryTypeCount; i++)
+    {
+        if ((type_bits & (1u << i)) == 0)
+            continue;
+
+        const auto flags = memory_properties.memoryTypes[i].propertyFlags;
+
+        if ((flags & required) != required)
+            continue;
+
+        if ((flags & preferred) == preferred)
+            return i;
+
+        if (!fallback)
+            fallback = i;
+    }
+
+    return fallback;
+}
+
+auto VulkanRenderer::allocate_memory(const vk::MemoryRequirements& requirements, MemoryUsage memory_usage,
+                                     bool optimal_tiling) -> std::expected<MemoryAllocation, std::string>
+{
+    auto [required, preferred] = [memory_usage]() -> std::array<vk::MemoryPropertyFlags, 2> {
+        using enum vk::MemoryPropertyFlagBits;
+
+        switch (memory_usage)
+        {
+        case MemoryUsage::GpuOnly:
+            return { eDeviceLocal, {} };
+        case MemoryUsage::Upload:
+            return { eHostVisible | eHostCoherent, {} };
+        case MemoryUsage::Readback:
+            // Uncached memory is very slow to read from on the CPU.
+            return { eHostVisible, eHostCached };
+        case MemoryUsage::Dynamic:
+            return { eDeviceLocal | eHostVisible | eHostCoherent, {} };
+        }
+
+        RENDERER_ASSERT(false);
+        return { eDeviceLocal, {} };
+    }();
+
+    const auto memory_type_index = find_memory_type(requirements.memoryTypeBits, required, preferred);
+
+    if (!memory_type_index)
+        return std::unexpected{ "No suitable memory type found." };
+
+    return _memory_allocator->allocate(_device, requirements, *memory_type_index, optimal_tiling);
+}
+
+auto VulkanRenderer::create_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryUsage memory_usage)
+    -> std::expected<Buffer, std::string>
+{
+    const auto buffer_create_info = vk::BufferCreateInfo{
+        .size = size,
+        .usage = usage,
+        .sharingMode = vk::SharingMode::eExclusive,
+    };
+
+    auto [create_buffer_result, buffer_handle] = _device.createBuffer(buffer_create_info);
+
+    if (create_buffer_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_buffer_result) };
+
+    auto allocation = allocate_memory(buffer_handle.getMemoryRequirements(), memory_usage, false);
+
+    if (!allocation)
+        return std::unexpected{ allocation.error() };
+
+    if (auto bind_result = buffer_handle.bindMemory(allocation->memory(), allocation->offset());
+        bind_result != vk::Result::eSuccess)
+    {
+        return std::unexpected{ vk::to_string(bind_result) };
+    }
+
+    // GPU-only memory may still be host-visible (e.g. with resizable BAR), but it's never accessed from the CPU.
+    auto* mapped = memory_usage != MemoryUsage::GpuOnly ? allocation->mapped() : nullptr;
+    RENDERER_ASSERT(memory_usage == MemoryUsage::GpuOnly || mapped);
+
+    return Buffer{
+        .allocation = std::move(*allocation),
+        .buffer = std::move(buffer_handle),
+        .size = size,
+        .mapped = mapped,
+    };
+}
+
+auto VulkanRenderer::create_dynamic_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage)
+    -> std::expected<DynamicBuffer, std::string>
+{
+    if (auto buffer = create_buffer(size, usage, MemoryUsage::Dynamic))
+    {
+        auto* mapped = buffer->mapped;
+        return DynamicBuffer{ .buffer = std::move(*buffer), .staging_buffer = {}, .mapped = mapped };
+    }
+
+    // Either there's no such memory, or its heap (e.g. a 256 MiB BAR without resizable BAR) is full.
+    auto buffer = create_buffer(size, usage | vk::BufferUsageFlagBits::eTransferDst, MemoryUsage::GpuOnly);
+
+    if (!buffer)
+        return std::unexpected{ buffer.error() };
+
+    auto staging_buffer = create_buffer(size, vk::BufferUsageFlagBits::eTransferSrc, MemoryUsage::Upload);
+
+    if (!staging_buffer)
+        return std::unexpected{ staging_buffer.error() };
+
+    auto* mapped = staging_buffer->mapped;
+
+    return DynamicBuffer{
+        .buffer = std::move(*buffer),
+        .staging_buffer = std::move(*staging_buffer),
+        .mapped = mapped,
+    };
+}
+
+auto VulkanRenderer::create_image(vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage,
+                                  vk::ImageAspectFlags aspect) -> std::expected<Image, std::string>
+{
+    const auto image_create_info = vk::ImageCreateInfo{
+        .imageType = vk::ImageType::e2D,
+        .format = format,
+        .extent = { extent.width, extent.height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = vk::SampleCountFlagBits::e1,
+        .tiling = vk::ImageTiling::eOptimal,
+        .usage = usage,
+        .sharingMode = vk::SharingMode::eExclusive,
+        .initialLayout = vk::ImageLayout::eUndefined,
+    };
+
+    auto [create_image_result, image_handle] = _device.createImage(image_create_info);
+
+    if (create_image_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_image_result) };
+
+    auto allocation = allocate_memory(image_handle.getMemoryRequirements(), MemoryUsage::GpuOnly, true);
+
+    if (!allocation)
+        return std::unexpected{ allocation.error() };
+
+    if (auto bind_result = image_handle.bindMemory(allocation->memory(), allocation->offset());
+        bind_result != vk::Result::eSuccess)
+    {
+        return std::unexpected{ vk::to_string(bind_result) };
+    }
+
+    const auto image_view_create_info = vk::ImageViewCreateInfo{
+        .image = *image_handle,
+        .viewType = vk::ImageViewType::e2D,
+        .format = format,
+        .subresourceRange = { .aspectMask = aspect,
+                              .baseMipLevel = 0,
+                              .levelCount = 1,
+                              .baseArrayLayer = 0,
+                              .layerCount = 1 },
+    };
+
+    auto [create_image_view_result, image_view] = _device.createImageView(image_view_create_info);
+
+    if (create_image_view_result != vk::Result::eSuccess)
+        return std::unexpected{ vk::to_string(create_image_view_result) };
+
+    return Image{
+        .allocation = std::move(*allocation),
+        .image = std::move(image_handle),
+        .image_view = std::move(image_view),
+        .extent = extent,
+        .format = format,
+    };
+}
+
 } // namespace renderer
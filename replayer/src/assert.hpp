@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <source_location>
+
+#if defined(RND_DEBUG_BREAKS)
+
+    #if defined(_MSC_VER)
+
+        #define REPLAYER_DEBUG_BREAK __debugbreak()
+
+    #elif defined(__GNUC__)
+
+        #define REPLAYER_DEBUG_BREAK __builtin_trap()
+
+    #elif defined(__clang__)
+
+        #define REPLAYER_DEBUG_BREAK __builtin_debugtrap()
+
+    #endif
+
+#else
+
+    #define REPLAYER_DEBUG_BREAK ((void)(0))
+
+#endif
+
+#define REPLAYER_ASSERT_IMPL(...)                                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if ((__VA_ARGS__)) [[likely]]                                                                                  \
+        {}                                                                                                             \
+        else [[unlikely]]                                                                                              \
+        {                                                                                                              \
+            auto source_location = std::source_location::current();                                                    \
+            std::cerr << source_location.file_name() << '(' << source_location.line() << ':'                           \
+                      << source_location.column() << ") `" << source_location.function_name()                          \
+                      << "`:\nAssertion failed: (" << #__VA_ARGS__ << ")\n";                                           \
+            REPLAYER_DEBUG_BREAK;                                                                                      \
+            std::abort();                                                                                              \
+        }                                                                                                              \
+    } while (false)
+
+#if defined(RND_ASSERTS)
+
+    #define REPLAYER_ASSERT(...) REPLAYER_ASSERT_IMPL(__VA_ARGS__)
+
+#else
+
+    #define REPLAYER_ASSERT(...) ((void)(0))
+
+#endif
+
+#define REPLAYER_RUNTIME_ASSERT(...) REPLAYER_ASSERT_IMPL(__VA_ARGS__)
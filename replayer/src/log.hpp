@@ -0,0 +1,10 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#define REPLAYER_TRACE(...) ::spdlog::trace(__VA_ARGS__)
+#define REPLAYER_DEBUG(...) ::spdlog::debug(__VA_ARGS__)
+#define REPLAYER_INFO(...) ::spdlog::info(__VA_ARGS__)
+#define REPLAYER_WARN(...) ::spdlog::warn(__VA_ARGS__)
+#define REPLAYER_ERROR(...) ::spdlog::error(__VA_ARGS__)
+#define REPLAYER_CRITICAL(...) ::spdlog::critical(__VA_ARGS__)
@@ -0,0 +1,201 @@
+#include <renderer/command_stream.hpp>
+#include <renderer/log.hpp>
+#include <renderer/vulkan_renderer.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "assert.hpp"
+#include "common.hpp"
+#include "defer.hpp"
+#include "log.hpp"
+
+namespace replayer {
+
+namespace {
+
+auto renderer_log_callback(renderer::LogLevel level, std::string_view message) -> void
+{
+    switch (level)
+    {
+        using enum renderer::LogLevel;
+    case Info:
+        REPLAYER_INFO("[Renderer]: {}", message);
+        break;
+    case Warning:
+        REPLAYER_WARN("[Renderer]: {}", message);
+        break;
+    case Error:
+        REPLAYER_ERROR("[Renderer]: {}", message);
+        break;
+    default:
+        REPLAYER_ASSERT(false);
+    }
+}
+
+const auto application_name = std::string{ "Replayer" };
+
+struct Options
+{
+    std::string stream_path{};
+    // Overrides the render target size the stream was recorded with.
+    std::optional<std::array<u32, 2>> size{ std::nullopt };
+    // Number of times to replay the stream on the same renderer. Later passes run with warm caches and pipelines.
+    u32 repeat{ 1 };
+};
+
+template<typename T> auto parse_number(std::string_view string) -> std::optional<T>
+{
+    auto value = T{};
+
+    if (std::from_chars(string.data(), string.data() + string.size(), value).ec != std::errc{})
+        return std::nullopt;
+
+    return value;
+}
+
+auto parse_size(std::string_view string) -> std::optional<std::array<u32, 2>>
+{
+    const auto separator = string.find('x');
+
+    if (separator == std::string_view::npos)
+        return std::nullopt;
+
+    auto width = parse_number<u32>(string.substr(0, separator));
+    auto height = parse_number<u32>(string.substr(separator + 1));
+
+    if (!width || !height || *width == 0 || *height == 0)
+        return std::nullopt;
+
+    return std::array{ *width, *height };
+}
+
+// Returns nullopt if no command stream was given.
+auto parse_options(std::span<char* const> args) -> std::optional<Options>
+{
+    auto options = Options{};
+
+    for (usize i = 1; i < args.size(); i++)
+    {
+        const auto arg = std::string_view{ args[i] };
+        const auto has_value = i + 1 < args.size();
+
+        if (arg == "--size" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto size = parse_size(value))
+                options.size = *size;
+            else
+                REPLAYER_WARN("Invalid size: {}. Expected WIDTHxHEIGHT.", value);
+        }
+        else if (arg == "--repeat" && has_value)
+        {
+            const auto value = std::string_view{ args[++i] };
+
+            if (auto repeat = parse_number<u32>(value); repeat && *repeat > 0)
+                options.repeat = *repeat;
+            else
+                REPLAYER_WARN("Invalid repeat count: {}.", value);
+        }
+        else if (!arg.starts_with("--") && options.stream_path.empty())
+        {
+            options.stream_path = arg;
+        }
+        else
+        {
+            REPLAYER_WARN("Unknown argument: {}.", arg);
+        }
+    }
+
+    if (options.stream_path.empty())
+        return std::nullopt;
+
+    return options;
+}
+
+auto to_ms(std::chrono::nanoseconds duration) -> f64
+{
+    return std::chrono::duration<f64, std::milli>{ duration }.count();
+}
+
+auto run(const Options& options) -> int
+{
+    Defer shutdown_spdlog{ [] { spdlog::shutdown(); } };
+
+    renderer::register_log_callback(renderer_log_callback);
+
+    auto stream = renderer::CommandStream::load(options.stream_path);
+
+    if (!stream)
+    {
+        REPLAYER_CRITICAL("Failed to load the command stream: {}", stream.error());
+        return EXIT_FAILURE;
+    }
+
+    const auto [width, height] = options.size.value_or(std::array{ stream->width(), stream->height() });
+
+    // Headless, so that frames are never throttled by presentation.
+    auto renderer = renderer::VulkanRenderer::create_headless(application_name.c_str(), width, height);
+
+    if (!renderer)
+    {
+        REPLAYER_CRITICAL("Failed to initialize the renderer: {}.", renderer.error());
+        return EXIT_FAILURE;
+    }
+
+    REPLAYER_INFO("Replaying {} at {}x{}.", options.stream_path, width, height);
+
+    auto best_frames_per_second = 0.0;
+
+    for (u32 pass = 0; pass < options.repeat; pass++)
+    {
+        auto stats = stream->replay(*renderer);
+
+        if (!stats)
+        {
+            REPLAYER_CRITICAL("Replay failed: {}", stats.error());
+            return EXIT_FAILURE;
+        }
+
+        const auto seconds = std::chrono::duration<f64>{ stats->duration }.count();
+        // A pass without frames (or one faster than the clock resolution) has no meaningful rate.
+        const auto frames_per_second = seconds > 0.0 ? static_cast<f64>(stats->frame_count) / seconds : 0.0;
+        best_frames_per_second = std::max(best_frames_per_second, frames_per_second);
+
+        REPLAYER_INFO("Pass {}: {} frames ({} commands) in {:.2f} s ({:.1f} frames/s). Frame time: min {:.2f} ms, "
+                      "avg {:.2f} ms, max {:.2f} ms.",
+                      pass + 1, stats->frame_count, stats->command_count, seconds, frames_per_second,
+                      to_ms(stats->min_frame_time), to_ms(stats->average_frame_time), to_ms(stats->max_frame_time));
+    }
+
+    if (options.repeat > 1)
+        REPLAYER_INFO("Best pass: {:.1f} frames/s.", best_frames_per_second);
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+} // namespace replayer
+
+auto main(int argc, char* argv[]) -> int
+{
+    auto options = replayer::parse_options(std::span{ argv, static_cast<replayer::usize>(argc) });
+
+    if (!options)
+    {
+        REPLAYER_CRITICAL("Usage: replayer <command stream> [--size WIDTHxHEIGHT] [--repeat COUNT]");
+        return EXIT_FAILURE;
+    }
+
+    return replayer::run(*options);
+}